@@ -11,6 +11,18 @@ CONFIG -= app_bundle
 SOURCES += \
         main.cpp
 
+# link the static driver, see SqliteCipher.pro
+qsqliteex_static {
+    DEFINES += QSQLITEEX_STATIC
+    INCLUDEPATH += $$PWD/../SqliteCipher
+    CONFIG(debug, debug|release){
+        win32: LIBS += -L$$PWD/../output/debug/sqldrivers -lSQLITEEXD
+        else: LIBS += -L$$PWD/../output/debug/sqldrivers -lSQLITEEX
+    } else {
+        LIBS += -L$$PWD/../output/release/sqldrivers -lSQLITEEX
+    }
+}
+
 CONFIG(debug, debug|release){
     DESTDIR = $$PWD/../output/debug
 } else {
@@ -4,6 +4,9 @@
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QSqlQuery>
+#ifdef QSQLITEEX_STATIC
+#include "mysqlitecipherplugin.h"
+#endif
 
 #define DATABASE_PATH                   "./Database/"
 #define DATABASE_DEFAULT_CONNECTION     "qt_sql_default_connection"
@@ -30,6 +33,10 @@ int main(int argc, char *argv[])
         dbDir.mkdir(dbDir.absolutePath());
     }
 
+#ifdef QSQLITEEX_STATIC
+    // the driver is linked in, register it without searching the sqldrivers folder
+    MySqliteCipherPlugin::registerDriver();
+#endif
     qDebug() << "Supported:" << QSqlDatabase::drivers();
     QSqlDatabase m_dataBase;
     if(QSqlDatabase::contains(DATABASE_DEFAULT_CONNECTION)){
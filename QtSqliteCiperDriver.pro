@@ -3,3 +3,11 @@ TEMPLATE = subdirs
 SUBDIRS += \
     Demo \
     SqliteCipher
+
+Demo.depends = SqliteCipher
+
+# the benchmarks link the driver, so they are only built with CONFIG+=qsqliteex_static
+qsqliteex_static {
+    SUBDIRS += bench
+    bench.depends = SqliteCipher
+}
@@ -3,16 +3,28 @@ QT += sql
 TEMPLATE = lib
 CONFIG += c++11 plugin
 
+# qmake "CONFIG+=qsqliteex_static" builds a static library to link into the application, which
+# then uses Q_IMPORT_PLUGIN(MySqliteCipherPlugin) or MySqliteCipherPlugin::registerDriver()
+qsqliteex_static {
+    CONFIG += static
+    DEFINES += QSQLITEEX_STATIC
+}
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 # Include QT private classes
-INCLUDEPATH += \
-    $$[QT_INSTALL_HEADERS]/QtCore/$$[QT_VERSION]/QtCore \
-    $$[QT_INSTALL_HEADERS]/QtSql/$$[QT_VERSION]/QtSql \
-    $$[QT_INSTALL_HEADERS]/QtCore/$$[QT_VERSION] \
-    $$[QT_INSTALL_HEADERS]/QtSql/$$[QT_VERSION]
+greaterThan(QT_MAJOR_VERSION, 5) {
+    QT += sql-private
+    CONFIG += c++17
+} else {
+    INCLUDEPATH += \
+        $$[QT_INSTALL_HEADERS]/QtCore/$$[QT_VERSION]/QtCore \
+        $$[QT_INSTALL_HEADERS]/QtSql/$$[QT_VERSION]/QtSql \
+        $$[QT_INSTALL_HEADERS]/QtCore/$$[QT_VERSION] \
+        $$[QT_INSTALL_HEADERS]/QtSql/$$[QT_VERSION]
+}
 
 # SQLITE_DQS                    Setting for the double-quoted string literal misfeature (default: disabled)
 # SQLITE_ENABLE_CARRAY          C array extension
@@ -52,34 +64,32 @@ INCLUDEPATH += \
 DEFINES += \
     SQLITE_ENABLE_COLUMN_METADATA \
     SQLITE_SOUNDEX \
-    SQLITE_SECURE_DELETE \
     SQLITE_ENABLE_JSON1 \
     SQLITE_ENABLE_REGEXP \
     SQLITE_ENABLE_EXTFUNC \
     SQLITE_ENABLE_FTS5 \
+    SQLITE_ENABLE_CARRAY \
+    SQLITE_ENABLE_DESERIALIZE \
     CODEC_TYPE=CODEC_TYPE_AES256
 
-# compile under Qt 5.12.12(windows)
+# one driver source for Qt 5.6.0(linux), Qt 5.12.12(windows) and Qt 6, see the QT_VERSION checks
 win32{
     Debug:TARGET = SQLITEEXD
     Release:TARGET = SQLITEEX
     DEFINES += DISABLE_AES_HARDWARE OS_WIN
-    SOURCES += qsql_sqliteex.cpp
-    HEADERS += qsql_sqliteex_p.h
 }
-# compile under Qt 5.6.0(linux)
 unix{
     TARGET = SQLITEEX
-    SOURCES += qsql_sqliteex_qt5.6.0.cpp
-    HEADERS += qsql_sqliteex_p_qt5.6.0.h
 }
 
 SOURCES += \
     mysqlitecipherplugin.cpp \
+    qsql_sqliteex.cpp \
     sqlite3mc_amalgamation.c
 
 HEADERS += \
     mysqlitecipherplugin.h \
+    qsql_sqliteex_p.h \
     sqlite3mc_amalgamation.h
 
 DISTFILES += MySqliteCipher.json
@@ -1,15 +1,22 @@
 #include "mysqlitecipherplugin.h"
-#ifdef OS_WIN
 #include "qsql_sqliteex_p.h"
-#else
-#include "qsql_sqliteex_p_qt5.6.0.h"
-#endif
+
+#include <QSqlDatabase>
 
 MySqliteCipherPlugin::MySqliteCipherPlugin(QObject *parent)
     : QSqlDriverPlugin(parent)
 {
 }
 
+/*
+    Registers QSQLITEEX with QSqlDatabase directly, for applications that link the static driver
+    library: no plugin lookup takes place. Call it once before QSqlDatabase::addDatabase().
+*/
+void MySqliteCipherPlugin::registerDriver()
+{
+    QSqlDatabase::registerSqlDriver(QStringLiteral("QSQLITEEX"), new QSqlDriverCreator<QSQLiteExDriver>);
+}
+
 QSqlDriver *MySqliteCipherPlugin::create(const QString &key)
 {
     if (key == QLatin1String("QSQLITEEX")) {
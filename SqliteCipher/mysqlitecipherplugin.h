@@ -11,6 +11,8 @@ class MySqliteCipherPlugin : public QSqlDriverPlugin
 public:
     explicit MySqliteCipherPlugin(QObject *parent = nullptr);
 
+    static void registerDriver();
+
 private:
     QSqlDriver *create(const QString &key) override;
 };
@@ -41,6 +41,7 @@
 
 #include <qcoreapplication.h>
 #include <qdatetime.h>
+#include <qendian.h>
 #include <qvariant.h>
 #include <qsqlerror.h>
 #include <qsqlfield.h>
@@ -48,14 +49,39 @@
 #include <qsqlquery.h>
 #include <QtSql/private/qsqlcachedresult_p.h>
 #include <QtSql/private/qsqldriver_p.h>
+#include <qhash.h>
+#include <qjsondocument.h>
+#include <qmutex.h>
+#include <qpointer.h>
 #include <qstringlist.h>
+#include <qthread.h>
+#include <qtimer.h>
+#include <quuid.h>
 #include <qvector.h>
+#include <qwaitcondition.h>
 #include <qdebug.h>
-#if QT_CONFIG(regularexpression)
+#include <qelapsedtimer.h>
+#include <qfile.h>
+#include <qjsonarray.h>
+#include <qjsonobject.h>
+#include <qnumeric.h>
+#include <qurl.h>
+
+#include <algorithm>
+
+// one source for Qt 5.6 (the Linux ARM build) and later
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+#  if QT_CONFIG(regularexpression)
+#    define QSQLITEEX_REGEXP
+#  endif
+#elif !defined(QT_NO_REGULAREXPRESSION)
+#  define QSQLITEEX_REGEXP
+#endif
+
+#ifdef QSQLITEEX_REGEXP
 #include <qcache.h>
 #include <qregularexpression.h>
 #endif
-#include <QScopedValueRollback>
 
 #if defined Q_OS_WIN
 # include <qt_windows.h>
@@ -65,7 +91,9 @@
 
 //#include <sqlite3.h>
 #include "sqlite3mc_amalgamation.h"
+#include <cmath>
 #include <functional>
+#include <limits>
 
 Q_DECLARE_OPAQUE_POINTER(sqlite3*)
 Q_DECLARE_METATYPE(sqlite3*)
@@ -75,6 +103,13 @@ Q_DECLARE_METATYPE(sqlite3_stmt*)
 
 QT_BEGIN_NAMESPACE
 
+#if QT_VERSION < QT_VERSION_CHECK(5, 7, 0)
+template <typename T>
+Q_DECL_CONSTEXPR typename std::add_const<T>::type &qAsConst(T &t) Q_DECL_NOTHROW { return t; }
+template <typename T>
+void qAsConst(const T &&) Q_DECL_EQ_DELETE;
+#endif
+
 static QString _q_escapeIdentifier(const QString &identifier)
 {
     QString res = identifier;
@@ -86,24 +121,51 @@ static QString _q_escapeIdentifier(const QString &identifier)
     return res;
 }
 
-static QVariant::Type qGetColumnType(const QString &tpName)
+static int qExecSql(sqlite3 *access, const QString &sql)
+{
+    return sqlite3_exec(access, sql.toUtf8().constData(), NULL, NULL, NULL);
+}
+
+static QMetaType::Type qGetColumnType(const QString &tpName)
 {
     const QString typeName = tpName.toLower();
 
     if (typeName == QLatin1String("integer")
         || typeName == QLatin1String("int"))
-        return QVariant::Int;
+        return QMetaType::Int;
     if (typeName == QLatin1String("double")
         || typeName == QLatin1String("float")
         || typeName == QLatin1String("real")
         || typeName.startsWith(QLatin1String("numeric")))
-        return QVariant::Double;
+        return QMetaType::Double;
     if (typeName == QLatin1String("blob"))
-        return QVariant::ByteArray;
+        return QMetaType::QByteArray;
     if (typeName == QLatin1String("boolean")
         || typeName == QLatin1String("bool"))
-        return QVariant::Bool;
-    return QVariant::String;
+        return QMetaType::Bool;
+    return QMetaType::QString;
+}
+
+// QSqlField takes a QMetaType in Qt 6, a QVariant::Type before, and the table since 5.10
+static QSqlField qMakeField(const QString &name, QMetaType::Type type, const QString &tableName)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    return QSqlField(name, QMetaType(type), tableName);
+#elif QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    return QSqlField(name, QVariant::Type(type), tableName);
+#else
+    Q_UNUSED(tableName);
+    return QSqlField(name, QVariant::Type(type));
+#endif
+}
+
+static inline QVariant qNullString()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    return QVariant(QMetaType::fromType<QString>());
+#else
+    return QVariant(QVariant::String);
+#endif
 }
 
 static QSqlError qMakeError(sqlite3 *access, const QString &descr, QSqlError::ErrorType type,
@@ -138,6 +200,33 @@ protected:
     QSqlRecord record() const override;
     void detachFromResultSet() override;
     void virtual_hook(int id, void *data) override;
+
+private:
+    bool exec(const QVector<QVariant> &values);
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 7, 0)
+    QSQLiteExResultPrivate *d_ptr;
+#endif
+};
+
+class QSQLiteExMaintenance;
+
+// runtime counters of a statement flagged by the index advisor
+struct QSQLiteExStatementStats
+{
+    QSQLiteExStatementStats() : executions(0), fullScanSteps(0), sorts(0), autoIndexes(0) {}
+
+    int executions;
+    qint64 fullScanSteps;
+    qint64 sorts;
+    qint64 autoIndexes;
+};
+
+// columns and row count of a table created with createArrayTable()
+struct QSQLiteExArrayTable
+{
+    QVector<QSQLiteExArrayColumn> columns;
+    qint64 rowCount;
 };
 
 class QSQLiteExDriverPrivate : public QSqlDriverPrivate
@@ -145,39 +234,472 @@ class QSQLiteExDriverPrivate : public QSqlDriverPrivate
     Q_DECLARE_PUBLIC(QSQLiteExDriver)
 
 public:
-    inline QSQLiteExDriverPrivate() : QSqlDriverPrivate(), access(0) { dbmsType = QSqlDriver::SQLite; }
+    enum DateTimeEncoding { IsoDateTime, EpochSeconds, EpochMSecs };
+    enum { MaxStatementStats = 256 };
+
+    inline QSQLiteExDriverPrivate() : QSqlDriverPrivate(), access(0), readAheadRows(0),
+        dateTimeEncoding(IsoDateTime), arrayModule(false), openFlags(0), maintenance(0),
+        busyTimeout(0), vacuumTimer(0), vacuumSlice(0), indexAdvisor(false), fullScanThreshold(1000)
+        { dbmsType = QSqlDriver::SQLite; }
     sqlite3 *access;
+    int readAheadRows;
+    DateTimeEncoding dateTimeEncoding;
     QList <QSQLiteExResult *> results;
     QStringList notificationid;
+    QHash<QString, QByteArray> images; // read-only deserialized images, referenced by SQLite
+    QHash<QString, QSQLiteExArrayTable> arrayTables;
+    bool arrayModule;
+    // to open further connections on the same database
+    QString databaseName;
+    QByteArray key;
+    int openFlags;
+    QSQLiteExMaintenance *maintenance;
+    int busyTimeout;
+    QTimer *vacuumTimer;
+    int vacuumSlice;
+    bool indexAdvisor;
+    int fullScanThreshold;
+    QHash<QString, QSQLiteExStatementStats> statementStats; // by SQL, the MaxStatementStats worst
+
+    bool isIdle() const;
+};
+
+// no open transaction and no statement in the middle of stepping
+bool QSQLiteExDriverPrivate::isIdle() const
+{
+    if (!sqlite3_get_autocommit(access))
+        return false;
+    for (sqlite3_stmt *stmt = sqlite3_next_stmt(access, 0); stmt; stmt = sqlite3_next_stmt(access, stmt)) {
+        if (sqlite3_stmt_busy(stmt))
+            return false;
+    }
+    return true;
+}
+
+
+// declared column types that are decoded into something else than the storage class
+enum QSQLiteExColumnHint { NoHint, DateTimeHint, DateHint, UuidHint };
+
+static char qGetColumnHint(const char *declType)
+{
+    if (!declType)
+        return NoHint;
+    if (qstricmp(declType, "datetime") == 0 || qstricmp(declType, "timestamp") == 0)
+        return DateTimeHint;
+    if (qstricmp(declType, "date") == 0)
+        return DateHint;
+    if (qstricmp(declType, "uuid") == 0 || qstricmp(declType, "guid") == 0)
+        return UuidHint;
+    return NoHint;
+}
+
+static qint64 qEpochToMSecs(qint64 value, int encoding)
+{
+    return encoding == QSQLiteExDriverPrivate::EpochSeconds ? value * 1000 : value;
+}
+
+// Dates are stored as UTC midnight. Counting days from the epoch avoids the
+// Qt::TimeSpec constructors, which are deprecated since Qt 6.5.
+static const qint64 qMSecsPerDay = Q_INT64_C(86400000);
+
+static QDate qEpochMSecsToDate(qint64 msecs)
+{
+    qint64 days = msecs / qMSecsPerDay;
+    if (msecs % qMSecsPerDay < 0)
+        --days;
+    return QDate(1970, 1, 1).addDays(days);
+}
+
+static qint64 qDateToEpochMSecs(const QDate &date)
+{
+    return QDate(1970, 1, 1).daysTo(date) * qMSecsPerDay;
+}
+
+static qint64 qMSecsToEpoch(qint64 msecs, int encoding)
+{
+    if (encoding != QSQLiteExDriverPrivate::EpochSeconds)
+        return msecs;
+    // round towards negative infinity, pre 1970 values must not move forward
+    return msecs >= 0 ? msecs / 1000 : -((-msecs + 999) / 1000);
+}
+
+// how fetched values are decoded, copied to the read-ahead thread
+struct QSQLiteExRowFormat
+{
+    QSQLiteExRowFormat() : nCols(0), policy(QSql::LowPrecisionDouble), dateTimeEncoding(0) {}
+
+    int nCols;
+    QSql::NumericalPrecisionPolicy policy;
+    int dateTimeEncoding;
+    QVector<char> hints; // QSQLiteExColumnHint per column, empty if no column has one
+};
+
+static void qReadRow(sqlite3_stmt *stmt, const QSQLiteExRowFormat &format, QVariant *values)
+{
+    const char *hints = format.hints.isEmpty() ? 0 : format.hints.constData();
+    for (int i = 0; i < format.nCols; ++i) {
+        switch (sqlite3_column_type(stmt, i)) {
+        case SQLITE_BLOB:
+            if (hints && hints[i] == UuidHint && sqlite3_column_bytes(stmt, i) == 16) {
+                values[i] = QUuid::fromRfc4122(QByteArray::fromRawData(
+                            static_cast<const char *>(sqlite3_column_blob(stmt, i)), 16));
+                break;
+            }
+            values[i] = QByteArray(static_cast<const char *>(
+                        sqlite3_column_blob(stmt, i)),
+                        sqlite3_column_bytes(stmt, i));
+            break;
+        case SQLITE_INTEGER:
+            if (hints && format.dateTimeEncoding != QSQLiteExDriverPrivate::IsoDateTime) {
+                if (hints[i] == DateTimeHint) {
+                    values[i] = QDateTime::fromMSecsSinceEpoch(
+                                qEpochToMSecs(sqlite3_column_int64(stmt, i), format.dateTimeEncoding));
+                    break;
+                } else if (hints[i] == DateHint) {
+                    values[i] = qEpochMSecsToDate(
+                                qEpochToMSecs(sqlite3_column_int64(stmt, i), format.dateTimeEncoding));
+                    break;
+                }
+            }
+            values[i] = sqlite3_column_int64(stmt, i);
+            break;
+        case SQLITE_FLOAT:
+            switch(format.policy) {
+                case QSql::LowPrecisionInt32:
+                    values[i] = sqlite3_column_int(stmt, i);
+                    break;
+                case QSql::LowPrecisionInt64:
+                    values[i] = sqlite3_column_int64(stmt, i);
+                    break;
+                case QSql::LowPrecisionDouble:
+                case QSql::HighPrecision:
+                default:
+                    values[i] = sqlite3_column_double(stmt, i);
+                    break;
+            };
+            break;
+        case SQLITE_NULL:
+            values[i] = qNullString();
+            break;
+        default:
+            values[i] = QString(reinterpret_cast<const QChar *>(
+                        sqlite3_column_text16(stmt, i)),
+                        sqlite3_column_bytes16(stmt, i) / sizeof(QChar));
+            break;
+        }
+    }
+}
+
+// Steps a forward-only statement on a helper thread and decodes the rows
+// into a bounded ring buffer, so decryption overlaps with the consumer.
+class QSQLiteExReadAhead : public QThread
+{
+public:
+    QSQLiteExReadAhead(sqlite3_stmt *stmt, const QSQLiteExRowFormat &format, int capacity);
+    ~QSQLiteExReadAhead();
+
+    // moves the next row into values (if not null) and returns SQLITE_ROW,
+    // or the result code that ended the scan
+    int next(QVariant *values);
+
+protected:
+    void run() override;
+
+private:
+    sqlite3_stmt *stmt;
+    const QSQLiteExRowFormat format;
+    QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+    QVector<QVector<QVariant> > ring;
+    int head;
+    int count;
+    int status;
+    bool stopping;
+};
+
+QSQLiteExReadAhead::QSQLiteExReadAhead(sqlite3_stmt *stmt, const QSQLiteExRowFormat &format,
+                                       int capacity)
+    : stmt(stmt), format(format),
+      ring(qMax(capacity, 1), QVector<QVariant>(format.nCols)),
+      head(0), count(0), status(SQLITE_ROW), stopping(false)
+{
+}
+
+QSQLiteExReadAhead::~QSQLiteExReadAhead()
+{
+    mutex.lock();
+    stopping = true;
+    notFull.wakeAll();
+    mutex.unlock();
+    wait();
+}
+
+void QSQLiteExReadAhead::run()
+{
+    QVector<QVariant> *rows = ring.data();
+    for (;;) {
+        mutex.lock();
+        while (count == ring.size() && !stopping)
+            notFull.wait(&mutex);
+        if (stopping) {
+            mutex.unlock();
+            return;
+        }
+        // the consumer never touches slots past head + count
+        const int tail = (head + count) % ring.size();
+        mutex.unlock();
+
+        const int res = sqlite3_step(stmt);
+        if (res == SQLITE_ROW)
+            qReadRow(stmt, format, rows[tail].data());
+
+        QMutexLocker locker(&mutex);
+        if (res == SQLITE_ROW)
+            ++count;
+        else
+            status = res;
+        notEmpty.wakeOne();
+        if (res != SQLITE_ROW)
+            return;
+    }
+}
+
+int QSQLiteExReadAhead::next(QVariant *values)
+{
+    QMutexLocker locker(&mutex);
+    while (count == 0 && status == SQLITE_ROW)
+        notEmpty.wait(&mutex);
+    if (count == 0)
+        return status;
+
+    QVector<QVariant> &row = ring[head];
+    if (values) {
+        for (int i = 0; i < format.nCols; ++i)
+            qSwap(values[i], row[i]);
+    }
+    head = (head + 1) % ring.size();
+    --count;
+    notFull.wakeOne();
+    return SQLITE_ROW;
+}
+
+// Bump allocator for the text and blob cells of QSQLiteExDriver::fetchRows().
+// reset() rewinds it but keeps the blocks, so a steady scan stops allocating.
+class QSQLiteExArena
+{
+public:
+    QSQLiteExArena() : current(-1), used(0), largeUsed(0) {}
+    ~QSQLiteExArena() { clear(); }
+
+    char *allocate(int size);
+    void reset();
+    void clear();
+
+private:
+    Q_DISABLE_COPY(QSQLiteExArena)
+
+    enum { BlockSize = 64 * 1024 };
+    QVector<char *> blocks;
+    // allocations of more than a quarter block, each in a buffer of its own; reset() keeps
+    // the buffers for the next batch, the first largeUsed are handed out
+    QVector<QPair<char *, int> > large;
+    int current;
+    int used;
+    int largeUsed;
 };
 
+char *QSQLiteExArena::allocate(int size)
+{
+    if (size > BlockSize / 4) {
+        // the smallest free buffer that fits, so big ones stay available for big cells
+        int fit = -1;
+        for (int i = largeUsed; i < large.count(); ++i) {
+            if (large.at(i).second >= size && (fit < 0 || large.at(i).second < large.at(fit).second))
+                fit = i;
+        }
+        if (fit < 0) {
+            large.append(qMakePair(new char[size], size));
+            fit = large.count() - 1;
+        }
+        std::swap(large[fit], large[largeUsed]);
+        return large.at(largeUsed++).first;
+    }
+    if (current < 0 || used + size > BlockSize) {
+        ++current;
+        used = 0;
+        if (current == blocks.count())
+            blocks.append(new char[BlockSize]);
+    }
+    char *data = blocks.at(current) + used;
+    // keep 8 byte alignment for the next one
+    used += (size + 7) & ~7;
+    return data;
+}
+
+// rewinds the arena, keeping its memory for the next batch
+void QSQLiteExArena::reset()
+{
+    current = -1;
+    used = 0;
+    largeUsed = 0;
+}
+
+void QSQLiteExArena::clear()
+{
+    reset();
+    for (int i = 0; i < blocks.count(); ++i)
+        delete [] blocks.at(i);
+    blocks.clear();
+    for (int i = 0; i < large.count(); ++i)
+        delete [] large.at(i).first;
+    large.clear();
+}
+
+static int qBindText(sqlite3_stmt *stmt, int index, const QString &str)
+{
+    // SQLITE_TRANSIENT makes sure that sqlite buffers the data
+    return sqlite3_bind_text16(stmt, index, str.utf16(), str.size() * sizeof(QChar), SQLITE_TRANSIENT);
+}
+
+static int qBindValue(sqlite3_stmt *stmt, int index, const QVariant &value, int dateTimeEncoding)
+{
+    if (value.isNull())
+        return sqlite3_bind_null(stmt, index);
+
+    switch (value.userType()) {
+    case QMetaType::QByteArray: {
+        const QByteArray *ba = static_cast<const QByteArray*>(value.constData());
+        return sqlite3_bind_blob(stmt, index, ba->constData(), ba->size(), SQLITE_STATIC); }
+    case QMetaType::Int:
+    case QMetaType::Bool:
+    case QMetaType::Short:
+    case QMetaType::UShort:
+    case QMetaType::Char:
+    case QMetaType::SChar:
+    case QMetaType::UChar:
+        return sqlite3_bind_int(stmt, index, value.toInt());
+    case QMetaType::Double:
+        return sqlite3_bind_double(stmt, index, value.toDouble());
+    case QMetaType::Float:
+        return sqlite3_bind_double(stmt, index, *static_cast<const float*>(value.constData()));
+    case QMetaType::UInt:
+    case QMetaType::Long:
+    case QMetaType::LongLong:
+        return sqlite3_bind_int64(stmt, index, value.toLongLong());
+    case QMetaType::ULong:
+    case QMetaType::ULongLong: {
+        const qulonglong v = value.toULongLong();
+        if (v <= qulonglong(std::numeric_limits<qint64>::max()))
+            return sqlite3_bind_int64(stmt, index, qint64(v));
+        return qBindText(stmt, index, value.toString()); }
+    case QMetaType::QDateTime: {
+        const QDateTime dateTime = value.toDateTime();
+        if (dateTimeEncoding != QSQLiteExDriverPrivate::IsoDateTime)
+            return sqlite3_bind_int64(stmt, index, qMSecsToEpoch(dateTime.toMSecsSinceEpoch(), dateTimeEncoding));
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+        return qBindText(stmt, index, dateTime.toString(Qt::ISODateWithMs)); }
+#else
+        return qBindText(stmt, index, dateTime.toString(QStringLiteral("yyyy-MM-ddThh:mm:ss.zzz"))); }
+#endif
+    case QMetaType::QDate: {
+        const QDate date = value.toDate();
+        if (dateTimeEncoding != QSQLiteExDriverPrivate::IsoDateTime) {
+            return sqlite3_bind_int64(stmt, index, qMSecsToEpoch(qDateToEpochMSecs(date), dateTimeEncoding));
+        }
+        return qBindText(stmt, index, date.toString(Qt::ISODate)); }
+    case QMetaType::QTime:
+        return qBindText(stmt, index, value.toTime().toString(QStringLiteral("hh:mm:ss.zzz")));
+    case QMetaType::QString: {
+        // lifetime of string == lifetime of its qvariant
+        const QString *str = static_cast<const QString*>(value.constData());
+        return sqlite3_bind_text16(stmt, index, str->utf16(), (str->size()) * sizeof(QChar), SQLITE_STATIC); }
+    case QMetaType::QUuid: {
+        // RFC 4122 byte order, without the temporary QByteArray of QUuid::toRfc4122()
+        const QUuid *uuid = static_cast<const QUuid*>(value.constData());
+        uchar bytes[16];
+        qToBigEndian<quint32>(uuid->data1, bytes);
+        qToBigEndian<quint16>(uuid->data2, bytes + 4);
+        qToBigEndian<quint16>(uuid->data3, bytes + 6);
+        memcpy(bytes + 8, uuid->data4, 8);
+        return sqlite3_bind_blob(stmt, index, bytes, 16, SQLITE_TRANSIENT); }
+    case QMetaType::QJsonDocument: {
+        // bound as UTF-8, saves the UTF-16 round trip of toString()
+        const QByteArray json = static_cast<const QJsonDocument*>(value.constData())->toJson(QJsonDocument::Compact);
+        return sqlite3_bind_text(stmt, index, json.constData(), json.size(), SQLITE_TRANSIENT); }
+    default:
+        return qBindText(stmt, index, value.toString());
+    }
+}
 
+#if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
 class QSQLiteExResultPrivate: public QSqlCachedResultPrivate
+#else
+// Qt 5.6 results keep their private part to themselves, this one is owned by QSQLiteExResult
+class QSQLiteExResultPrivate
+#endif
 {
     Q_DECLARE_PUBLIC(QSQLiteExResult)
 
 public:
+#if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
     Q_DECLARE_SQLDRIVER_PRIVATE(QSQLiteExDriver)
+#else
+    const QSQLiteExDriverPrivate *drv_d_func() const { return sqldriver ? sqldriver->d_func() : 0; }
+    QSQLiteExResult *q_ptr;
+    QPointer<QSQLiteExDriver> sqldriver;
+#endif
     QSQLiteExResultPrivate(QSQLiteExResult *q, const QSQLiteExDriver *drv);
     void cleanup();
     bool fetchNext(QSqlCachedResult::ValueCache &values, int idx, bool initialFetch);
-    // initializes the recordInfo and the cache
+    // initializes the cache and the column types of the first row
     void initColumns(bool emptyResultset);
+    QSqlRecord record() const;
+    void initColumnHints();
+    void mapParameters(int valueCount);
     void finalize();
+    void stopReadAhead();
+    void collectStatus();
+    // for fetchColumns() and fetchRows(), which step the statement themselves
+    bool beginBatch();
+    int stepBatch();
 
     sqlite3_stmt *stmt;
+    QSQLiteExReadAhead *readAhead;
+    QSQLiteExRowFormat format;
+    bool columnHintsValid; // hints only depend on the prepared statement
+    int reprepareCount; // SQLITE_STMTSTATUS_REPREPARE the hints and rInf were built for
+    QVector<int> paramValues; // bound value index of each parameter, empty if they match 1:1
+    int paramValueCount; // number of bound values paramValues was built for
+    bool paramsValid;
 
     bool skippedStatus; // the status of the fetchNext() that's skipped
     bool skipRow; // skip the next fetchNext()?
-    QSqlRecord rInf;
+    bool columnsValid; // initColumns() ran for the current exec()
+    QVector<int> columnTypes; // storage class of each column in the first row, -1 if there is none
+    // built by record() and kept with the prepared statement for the next exec()
+    mutable QSqlRecord rInf;
+    mutable QVector<int> rInfTypes;
     QVector<QVariant> firstRow;
+    QSQLiteExArena arena; // text and blobs of the last fetchRows()
 };
 
 QSQLiteExResultPrivate::QSQLiteExResultPrivate(QSQLiteExResult *q, const QSQLiteExDriver *drv)
+#if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
     : QSqlCachedResultPrivate(q, drv),
+#else
+    : q_ptr(q),
+      sqldriver(const_cast<QSQLiteExDriver *>(drv)),
+#endif
       stmt(0),
+      readAhead(0),
+      columnHintsValid(false),
+      reprepareCount(0),
+      paramValueCount(-1),
+      paramsValid(false),
       skippedStatus(false),
-      skipRow(false)
+      skipRow(false),
+      columnsValid(false)
 {
 }
 
@@ -185,7 +707,14 @@ void QSQLiteExResultPrivate::cleanup()
 {
     Q_Q(QSQLiteExResult);
     finalize();
+    arena.clear();
+    columnsValid = false;
     rInf.clear();
+    rInfTypes.clear();
+    columnHintsValid = false;
+    reprepareCount = 0;
+    paramValues.clear();
+    paramValueCount = -1;
     skippedStatus = false;
     skipRow = false;
     q->setAt(QSql::BeforeFirstRow);
@@ -195,23 +724,182 @@ void QSQLiteExResultPrivate::cleanup()
 
 void QSQLiteExResultPrivate::finalize()
 {
+    stopReadAhead();
     if (!stmt)
         return;
 
+    collectStatus();
     sqlite3_finalize(stmt);
     stmt = 0;
 }
 
+// hands the counters of the last execution to the index advisor and resets them
+void QSQLiteExResultPrivate::collectStatus()
+{
+    QSQLiteExDriverPrivate *drv = const_cast<QSQLiteExDriverPrivate *>(drv_d_func());
+    if (!drv || !drv->indexAdvisor || !stmt)
+        return;
+
+    const int fullScanSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+    const int sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+    const int autoIndexes = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+    if (fullScanSteps < drv->fullScanThreshold && sorts == 0 && autoIndexes == 0)
+        return;
+
+    // SQL with literals instead of placeholders makes a new entry per value, so only the
+    // statements with the most full scan steps are kept
+    const QString sql = QString::fromUtf8(sqlite3_sql(stmt));
+    auto it = drv->statementStats.find(sql);
+    if (it == drv->statementStats.end()) {
+        if (drv->statementStats.size() >= QSQLiteExDriverPrivate::MaxStatementStats) {
+            auto least = drv->statementStats.begin();
+            for (auto other = least; other != drv->statementStats.end(); ++other) {
+                if (other.value().fullScanSteps < least.value().fullScanSteps)
+                    least = other;
+            }
+            if (least.value().fullScanSteps >= fullScanSteps)
+                return;
+            drv->statementStats.erase(least);
+        }
+        it = drv->statementStats.insert(sql, QSQLiteExStatementStats());
+    }
+    QSQLiteExStatementStats &stats = it.value();
+    ++stats.executions;
+    stats.fullScanSteps += fullScanSteps;
+    stats.sorts += sorts;
+    stats.autoIndexes += autoIndexes;
+}
+
+void QSQLiteExResultPrivate::stopReadAhead()
+{
+    delete readAhead;
+    readAhead = 0;
+}
+
+// batches only work on forward-only selects that are not read ahead
+bool QSQLiteExResultPrivate::beginBatch()
+{
+    Q_Q(QSQLiteExResult);
+    if (!q->isActive() || !q->isSelect() || !q->isForwardOnly() || readAhead) {
+        q->setLastError(QSqlError(QCoreApplication::translate("QSQLiteExResult", "Unable to fetch row"),
+                                  QCoreApplication::translate("QSQLiteExResult",
+                                          "Not an active forward-only select"),
+                                  QSqlError::StatementError));
+        return false;
+    }
+    return true;
+}
+
+// returns SQLITE_ROW with the statement on the next row, SQLITE_DONE or the error
+// code after setting lastError
+int QSQLiteExResultPrivate::stepBatch()
+{
+    Q_Q(QSQLiteExResult);
+    if (q->at() == QSql::AfterLastRow)
+        return SQLITE_DONE;
+
+    int res;
+    if (skipRow) {
+        // exec() already stepped onto the first row
+        skipRow = false;
+        res = skippedStatus ? SQLITE_ROW : SQLITE_DONE;
+    } else {
+        res = sqlite3_step(stmt);
+    }
+
+    if (res == SQLITE_DONE) {
+        sqlite3_reset(stmt);
+        q->setAt(QSql::AfterLastRow);
+    } else if (res != SQLITE_ROW) {
+        res = sqlite3_reset(stmt);
+        q->setLastError(qMakeError(drv_d_func()->access, QCoreApplication::translate("QSQLiteExResult",
+                        "Unable to fetch row"), QSqlError::ConnectionError, res));
+        q->setAt(QSql::AfterLastRow);
+    }
+    return res;
+}
+
+void QSQLiteExResultPrivate::initColumnHints()
+{
+    format.hints.clear();
+    for (int i = 0; i < format.nCols; ++i) {
+        const char hint = qGetColumnHint(sqlite3_column_decltype(stmt, i));
+        if (hint != NoHint) {
+            format.hints.resize(format.nCols);
+            format.hints[i] = hint;
+        }
+    }
+    columnHintsValid = true;
+}
+
+// Named placeholders that are used more than once get one bound value per
+// occurrence, but SQLite has a single parameter for them. The mapping only
+// depends on the statement and the number of bound values, so it is built
+// once instead of on every exec().
+void QSQLiteExResultPrivate::mapParameters(int valueCount)
+{
+    Q_Q(QSQLiteExResult);
+    const int paramCount = sqlite3_bind_parameter_count(stmt);
+    paramValues.clear();
+    paramValueCount = valueCount;
+    paramsValid = paramCount == valueCount;
+
+#if (SQLITE_VERSION_NUMBER >= 3003011)
+    // We need to check explicitly that paramCount is greater than or equal to 1, as sqlite
+    // can end up in a case where for virtual tables it returns 0 even though it
+    // has parameters
+    if (paramCount >= 1 && paramCount < valueCount) {
+        paramValues.fill(-1, paramCount);
+        bool allValuesUsed = true;
+        for (int i = 0; i < valueCount; ++i) {
+            const int param = sqlite3_bind_parameter_index(stmt, q->boundValueName(i).toUtf8().constData());
+            if (param <= 0)
+                allValuesUsed = false;
+            else if (paramValues.at(param - 1) < 0)
+                paramValues[param - 1] = i;
+        }
+        paramsValid = allValuesUsed && !paramValues.contains(-1);
+    }
+#endif
+}
+
 void QSQLiteExResultPrivate::initColumns(bool emptyResultset)
 {
     Q_Q(QSQLiteExResult);
     int nCols = sqlite3_column_count(stmt);
+    columnsValid = nCols > 0;
     if (nCols <= 0)
         return;
 
     q->init(nCols);
+    format.nCols = nCols;
+    // a schema change recompiles the statement, which can change the names and declared types
+    const int reprepares = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_REPREPARE, 0);
+    if (reprepares != reprepareCount) {
+        reprepareCount = reprepares;
+        columnHintsValid = false;
+        rInf.clear();
+    }
+    if (!columnHintsValid)
+        initColumnHints();
 
-    for (int i = 0; i < nCols; ++i) {
+    // sqlite3_column_type is documented to have undefined behavior if the result set is empty
+    columnTypes.resize(nCols);
+    for (int i = 0; i < nCols; ++i)
+        columnTypes[i] = emptyResultset ? -1 : sqlite3_column_type(stmt, i);
+}
+
+// Column names, tables and declared types are only looked up when the record is asked for.
+// The record is reused while the statement stays prepared, unless SQLite reprepared it after
+// a schema change or the first row of this exec() has other storage classes, which decide
+// the type of columns without declared type.
+QSqlRecord QSQLiteExResultPrivate::record() const
+{
+    if (!rInf.isEmpty() && rInfTypes == columnTypes)
+        return rInf;
+
+    rInf.clear();
+    for (int i = 0; i < columnTypes.count(); ++i) {
         QString colName = QString(reinterpret_cast<const QChar *>(
                     sqlite3_column_name16(stmt, i))
                     ).remove(QLatin1Char('"'));
@@ -221,10 +909,9 @@ void QSQLiteExResultPrivate::initColumns(bool emptyResultset)
         // must use typeName for resolving the type to match QSQLiteExDriver::record
         QString typeName = QString(reinterpret_cast<const QChar *>(
                     sqlite3_column_decltype16(stmt, i)));
-        // sqlite3_column_type is documented to have undefined behavior if the result set is empty
-        int stp = emptyResultset ? -1 : sqlite3_column_type(stmt, i);
+        const int stp = columnTypes.at(i);
 
-        QVariant::Type fieldType;
+        QMetaType::Type fieldType;
 
         if (!typeName.isEmpty()) {
             fieldType = qGetColumnType(typeName);
@@ -232,35 +919,36 @@ void QSQLiteExResultPrivate::initColumns(bool emptyResultset)
             // Get the proper type for the field based on stp value
             switch (stp) {
             case SQLITE_INTEGER:
-                fieldType = QVariant::Int;
+                fieldType = QMetaType::Int;
                 break;
             case SQLITE_FLOAT:
-                fieldType = QVariant::Double;
+                fieldType = QMetaType::Double;
                 break;
             case SQLITE_BLOB:
-                fieldType = QVariant::ByteArray;
+                fieldType = QMetaType::QByteArray;
                 break;
             case SQLITE_TEXT:
-                fieldType = QVariant::String;
+                fieldType = QMetaType::QString;
                 break;
             case SQLITE_NULL:
             default:
-                fieldType = QVariant::Invalid;
+                fieldType = QMetaType::UnknownType;
                 break;
             }
         }
 
-        QSqlField fld(colName, fieldType, tableName);
+        QSqlField fld = qMakeField(colName, fieldType, tableName);
         fld.setSqlType(stp);
         rInf.append(fld);
     }
+    rInfTypes = columnTypes;
+    return rInf;
 }
 
 bool QSQLiteExResultPrivate::fetchNext(QSqlCachedResult::ValueCache &values, int idx, bool initialFetch)
 {
     Q_Q(QSQLiteExResult);
     int res;
-    int i;
 
     if (skipRow) {
         // already fetched
@@ -283,54 +971,33 @@ bool QSQLiteExResultPrivate::fetchNext(QSqlCachedResult::ValueCache &values, int
         q->setAt(QSql::AfterLastRow);
         return false;
     }
-    res = sqlite3_step(stmt);
+    bool rowRead = false;
+    const int readAheadRows = drv_d_func()->readAheadRows;
+    if (readAhead || (readAheadRows > 0 && !initialFetch && q->isForwardOnly() && columnsValid)) {
+        if (!readAhead) {
+            readAhead = new QSQLiteExReadAhead(stmt, format, readAheadRows);
+            readAhead->start();
+        }
+        res = readAhead->next(idx < 0 ? 0 : values.data() + idx);
+        if (res != SQLITE_ROW)
+            stopReadAhead();
+        rowRead = true;
+    } else {
+        res = sqlite3_step(stmt);
+    }
 
     switch(res) {
     case SQLITE_ROW:
         // check to see if should fill out columns
-        if (rInf.isEmpty())
+        if (!columnsValid)
             // must be first call.
             initColumns(false);
-        if (idx < 0 && !initialFetch)
+        if (rowRead || (idx < 0 && !initialFetch))
             return true;
-        for (i = 0; i < rInf.count(); ++i) {
-            switch (sqlite3_column_type(stmt, i)) {
-            case SQLITE_BLOB:
-                values[i + idx] = QByteArray(static_cast<const char *>(
-                            sqlite3_column_blob(stmt, i)),
-                            sqlite3_column_bytes(stmt, i));
-                break;
-            case SQLITE_INTEGER:
-                values[i + idx] = sqlite3_column_int64(stmt, i);
-                break;
-            case SQLITE_FLOAT:
-                switch(q->numericalPrecisionPolicy()) {
-                    case QSql::LowPrecisionInt32:
-                        values[i + idx] = sqlite3_column_int(stmt, i);
-                        break;
-                    case QSql::LowPrecisionInt64:
-                        values[i + idx] = sqlite3_column_int64(stmt, i);
-                        break;
-                    case QSql::LowPrecisionDouble:
-                    case QSql::HighPrecision:
-                    default:
-                        values[i + idx] = sqlite3_column_double(stmt, i);
-                        break;
-                };
-                break;
-            case SQLITE_NULL:
-                values[i + idx] = QVariant(QVariant::String);
-                break;
-            default:
-                values[i + idx] = QString(reinterpret_cast<const QChar *>(
-                            sqlite3_column_text16(stmt, i)),
-                            sqlite3_column_bytes16(stmt, i) / sizeof(QChar));
-                break;
-            }
-        }
+        qReadRow(stmt, format, values.data() + idx);
         return true;
     case SQLITE_DONE:
-        if (rInf.isEmpty())
+        if (!columnsValid)
             // must be first call.
             initColumns(true);
         q->setAt(QSql::AfterLastRow);
@@ -359,7 +1026,11 @@ bool QSQLiteExResultPrivate::fetchNext(QSqlCachedResult::ValueCache &values, int
 }
 
 QSQLiteExResult::QSQLiteExResult(const QSQLiteExDriver* db)
+#if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
     : QSqlCachedResult(*new QSQLiteExResultPrivate(this, db))
+#else
+    : QSqlCachedResult(db), d_ptr(new QSQLiteExResultPrivate(this, db))
+#endif
 {
     Q_D(QSQLiteExResult);
     const_cast<QSQLiteExDriverPrivate*>(d->drv_d_func())->results.append(this);
@@ -371,6 +1042,9 @@ QSQLiteExResult::~QSQLiteExResult()
     if (d->drv_d_func())
         const_cast<QSQLiteExDriverPrivate*>(d->drv_d_func())->results.removeOne(this);
     d->cleanup();
+#if QT_VERSION < QT_VERSION_CHECK(5, 7, 0)
+    delete d_ptr;
+#endif
 }
 
 void QSQLiteExResult::virtual_hook(int id, void *data)
@@ -422,37 +1096,52 @@ bool QSQLiteExResult::prepare(const QString &query)
 bool QSQLiteExResult::execBatch(bool arrayBind)
 {
     Q_UNUSED(arrayBind);
-    Q_D(QSqlResult);
-    QScopedValueRollback<QVector<QVariant>> valuesScope(d->values);
-    QVector<QVariant> values = d->values;
+    // each bound value is a list; the rows are executed with the values taken from the
+    // lists in place of the bound ones, through the same parameter mapping as exec(),
+    // so the bound values themselves stay as they are
+    const QVector<QVariant> values = boundValues();
     if (values.count() == 0)
         return false;
 
-    for (int i = 0; i < values.at(0).toList().count(); ++i) {
-        d->values.clear();
-        QScopedValueRollback<QHash<QString, QVector<int>>> indexesScope(d->indexes);
-        QHash<QString, QVector<int>>::const_iterator it = d->indexes.constBegin();
-        while (it != d->indexes.constEnd()) {
-            bindValue(it.key(), values.at(it.value().first()).toList().at(i), QSql::In);
-            ++it;
-        }
-        if (!exec())
-            return false;
+    QVector<QVariantList> lists(values.count());
+    for (int j = 0; j < values.count(); ++j)
+        lists[j] = values.at(j).toList();
+
+    bool ok = true;
+    const int rows = lists.at(0).count();
+    QVector<QVariant> row(values.count());
+    for (int i = 0; i < rows && ok; ++i) {
+        for (int j = 0; j < lists.count(); ++j)
+            row[j] = lists.at(j).value(i);
+        ok = exec(row);
     }
-    return true;
+    return ok;
 }
 
 bool QSQLiteExResult::exec()
 {
-    Q_D(QSQLiteExResult);
-    QVector<QVariant> values = boundValues();
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    return exec(boundValues(QT6_CALL_NEW_OVERLOAD));
+#else
+    return exec(boundValues());
+#endif
+}
 
+// executes the statement with values in place of the bound values, which they match
+// in count and order
+bool QSQLiteExResult::exec(const QVector<QVariant> &values)
+{
+    Q_D(QSQLiteExResult);
     d->skippedStatus = false;
     d->skipRow = false;
-    d->rInf.clear();
+    d->columnsValid = false;
+    d->stopReadAhead();
+    d->format.policy = numericalPrecisionPolicy();
+    d->format.dateTimeEncoding = d->drv_d_func()->dateTimeEncoding;
     clearValues();
     setLastError(QSqlError());
 
+    d->collectStatus();
     int res = sqlite3_reset(d->stmt);
     if (res != SQLITE_OK) {
         setLastError(qMakeError(d->drv_d_func()->access, QCoreApplication::translate("QSQLiteExResult",
@@ -461,96 +1150,14 @@ bool QSQLiteExResult::exec()
         return false;
     }
 
-    int paramCount = sqlite3_bind_parameter_count(d->stmt);
-    bool paramCountIsValid = paramCount == values.count();
+    const int paramCount = sqlite3_bind_parameter_count(d->stmt);
+    if (d->paramValueCount != values.count())
+        d->mapParameters(values.count());
 
-#if (SQLITE_VERSION_NUMBER >= 3003011)
-    // In the case of the reuse of a named placeholder
-    // We need to check explicitly that paramCount is greater than or equal to 1, as sqlite
-    // can end up in a case where for virtual tables it returns 0 even though it
-    // has parameters
-    if (paramCount >= 1 && paramCount < values.count()) {
-        const auto countIndexes = [](int counter, const QVector<int> &indexList) {
-                                      return counter + indexList.length();
-                                  };
-
-        const int bindParamCount = std::accumulate(d->indexes.cbegin(),
-                                                   d->indexes.cend(),
-                                                   0,
-                                                   countIndexes);
-
-        paramCountIsValid = bindParamCount == values.count();
-        // When using named placeholders, it will reuse the index for duplicated
-        // placeholders. So we need to ensure the QVector has only one instance of
-        // each value as SQLite will do the rest for us.
-        QVector<QVariant> prunedValues;
-        QVector<int> handledIndexes;
-        for (int i = 0, currentIndex = 0; i < values.size(); ++i) {
-            if (handledIndexes.contains(i))
-                continue;
-            const auto placeHolder = QString::fromUtf8(sqlite3_bind_parameter_name(d->stmt, currentIndex + 1));
-            const auto &indexes = d->indexes.value(placeHolder);
-            handledIndexes << indexes;
-            prunedValues << values.at(indexes.first());
-            ++currentIndex;
-        }
-        values = prunedValues;
-    }
-#endif
-
-    if (paramCountIsValid) {
+    if (d->paramsValid) {
         for (int i = 0; i < paramCount; ++i) {
-            res = SQLITE_OK;
-            const QVariant &value = values.at(i);
-
-            if (value.isNull()) {
-                res = sqlite3_bind_null(d->stmt, i + 1);
-            } else {
-                switch (value.type()) {
-                case QVariant::ByteArray: {
-                    const QByteArray *ba = static_cast<const QByteArray*>(value.constData());
-                    res = sqlite3_bind_blob(d->stmt, i + 1, ba->constData(),
-                                            ba->size(), SQLITE_STATIC);
-                    break; }
-                case QVariant::Int:
-                case QVariant::Bool:
-                    res = sqlite3_bind_int(d->stmt, i + 1, value.toInt());
-                    break;
-                case QVariant::Double:
-                    res = sqlite3_bind_double(d->stmt, i + 1, value.toDouble());
-                    break;
-                case QVariant::UInt:
-                case QVariant::LongLong:
-                    res = sqlite3_bind_int64(d->stmt, i + 1, value.toLongLong());
-                    break;
-                case QVariant::DateTime: {
-                    const QDateTime dateTime = value.toDateTime();
-                    const QString str = dateTime.toString(Qt::ISODateWithMs);
-                    res = sqlite3_bind_text16(d->stmt, i + 1, str.utf16(),
-                                              str.size() * sizeof(ushort), SQLITE_TRANSIENT);
-                    break;
-                }
-                case QVariant::Time: {
-                    const QTime time = value.toTime();
-                    const QString str = time.toString(QStringViewLiteral("hh:mm:ss.zzz"));
-                    res = sqlite3_bind_text16(d->stmt, i + 1, str.utf16(),
-                                              str.size() * sizeof(ushort), SQLITE_TRANSIENT);
-                    break;
-                }
-                case QVariant::String: {
-                    // lifetime of string == lifetime of its qvariant
-                    const QString *str = static_cast<const QString*>(value.constData());
-                    res = sqlite3_bind_text16(d->stmt, i + 1, str->utf16(),
-                                              (str->size()) * sizeof(QChar), SQLITE_STATIC);
-                    break; }
-                default: {
-                    QString str = value.toString();
-                    // SQLITE_TRANSIENT makes sure that sqlite buffers the data
-                    res = sqlite3_bind_text16(d->stmt, i + 1, str.utf16(),
-                                              (str.size()) * sizeof(QChar), SQLITE_TRANSIENT);
-                    break; }
-                }
-            }
+            const int valueIndex = d->paramValues.isEmpty() ? i : d->paramValues.at(i);
+            res = qBindValue(d->stmt, i + 1, values.at(valueIndex), d->format.dateTimeEncoding);
             if (res != SQLITE_OK) {
                 setLastError(qMakeError(d->drv_d_func()->access, QCoreApplication::translate("QSQLiteExResult",
                              "Unable to bind parameters"), QSqlError::StatementError, res));
@@ -569,7 +1176,7 @@ bool QSQLiteExResult::exec()
         setActive(false);
         return false;
     }
-    setSelect(!d->rInf.isEmpty());
+    setSelect(d->columnsValid);
     setActive(true);
     return true;
 }
@@ -607,12 +1214,13 @@ QSqlRecord QSQLiteExResult::record() const
     Q_D(const QSQLiteExResult);
     if (!isActive() || !isSelect())
         return QSqlRecord();
-    return d->rInf;
+    return d->record();
 }
 
 void QSQLiteExResult::detachFromResultSet()
 {
     Q_D(QSQLiteExResult);
+    d->stopReadAhead();
     if (d->stmt)
         sqlite3_reset(d->stmt);
 }
@@ -625,7 +1233,21 @@ QVariant QSQLiteExResult::handle() const
 
 /////////////////////////////////////////////////////////
 
-#if QT_CONFIG(regularexpression)
+#ifdef QSQLITEEX_REGEXP
+struct QSQLiteExRegexpCache
+{
+    explicit QSQLiteExRegexpCache(int size) : patterns(size) {}
+
+    QCache<QString, QRegularExpression> patterns;
+    QString subject; // reused through setRawData(), so rows are matched without an allocation
+};
+
+static void _q_regexp_delete(void *regexp)
+{
+    delete static_cast<QRegularExpression*>(regexp);
+}
+
+// registered as SQLITE_UTF16, SQLite hands over the text in the QChar layout
 static void _q_regexp(sqlite3_context* context, int argc, sqlite3_value** argv)
 {
     if (Q_UNLIKELY(argc != 2)) {
@@ -633,441 +1255,3688 @@ static void _q_regexp(sqlite3_context* context, int argc, sqlite3_value** argv)
         return;
     }
 
-    const QString pattern = QString::fromUtf8(
-        reinterpret_cast<const char*>(sqlite3_value_text(argv[0])));
-    const QString subject = QString::fromUtf8(
-        reinterpret_cast<const char*>(sqlite3_value_text(argv[1])));
-
-    auto cache = static_cast<QCache<QString, QRegularExpression>*>(sqlite3_user_data(context));
-    auto regexp = cache->object(pattern);
-    const bool wasCached = regexp;
-
-    if (!wasCached)
-        regexp = new QRegularExpression(pattern, QRegularExpression::DontCaptureOption);
-
-    const bool found = subject.contains(*regexp);
+    auto cache = static_cast<QSQLiteExRegexpCache*>(sqlite3_user_data(context));
+
+    // the compiled pattern stays attached to the statement as long as argv[0] does not change
+    const QRegularExpression *regexp = static_cast<QRegularExpression*>(sqlite3_get_auxdata(context, 0));
+    if (!regexp) {
+        const QString pattern(reinterpret_cast<const QChar*>(sqlite3_value_text16(argv[0])),
+                              sqlite3_value_bytes16(argv[0]) / sizeof(QChar));
+        QRegularExpression *cached = cache->patterns.object(pattern);
+        if (!cached) {
+            cached = new QRegularExpression(pattern, QRegularExpression::DontCaptureOption);
+            cached->optimize();
+            cache->patterns.insert(pattern, cached);
+        }
+        // an implicitly shared copy, it outlives an eviction from the cache
+        sqlite3_set_auxdata(context, 0, new QRegularExpression(*cached), &_q_regexp_delete);
+        regexp = cached;
+    }
 
-    if (!wasCached)
-        cache->insert(pattern, regexp);
+    const QChar *subject = reinterpret_cast<const QChar*>(sqlite3_value_text16(argv[1]));
+    cache->subject.setRawData(subject, sqlite3_value_bytes16(argv[1]) / sizeof(QChar));
+    const bool found = regexp->match(cache->subject).hasMatch();
 
     sqlite3_result_int(context, int(found));
 }
 
 static void _q_regexp_cleanup(void *cache)
 {
-    delete static_cast<QCache<QString, QRegularExpression>*>(cache);
+    delete static_cast<QSQLiteExRegexpCache*>(cache);
 }
 #endif
 
+/////////////////////////////////////////////////////////
+
+struct QSQLiteExFtsInstance;
+
+// one per registered tokenizer and connection, owned by FTS5
+struct QSQLiteExFtsModule
+{
+    QSQLiteExFtsTokenizer tokenizer;
+    QSQLiteExFtsTokenFilter filter;
+    fts5_api *api;
+    // tables created with the same tokenizer arguments share one instance
+    QHash<QByteArray, QSQLiteExFtsInstance *> instances;
+};
+
+struct QSQLiteExFtsInstance
+{
+    QSQLiteExFtsModule *module;
+    QByteArray key;
+    int ref;
+    // the tokenizer a filter is chained to
+    fts5_tokenizer parent;
+    Fts5Tokenizer *parentInstance;
+};
+
+class QSQLiteExFtsTokenSink : public QSQLiteExFtsTokens
+{
+public:
+    QSQLiteExFtsTokenSink(void *ctx, int (*xToken)(void *, int, const char *, int, int, int),
+                          const char *text, int size)
+        : res(SQLITE_OK), ctx(ctx), xToken(xToken), utf8(text)
+    {
+        // byte offset of every QChar, the tokenizer works on QString positions
+        offsets.reserve(size + 1);
+        for (int i = 0; i < size; ) {
+            const uchar c = uchar(text[i]);
+            const int length = c < 0x80 ? 1 : c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+            offsets.append(i);
+            if (length == 4)
+                offsets.append(i); // surrogate pair
+            i += length;
+        }
+        offsets.append(size);
+    }
+
+    bool add(int start, int end, bool colocated) override
+    {
+        const int from = offset(start);
+        const int to = offset(end);
+        return emitToken(utf8 + from, to - from, from, to, colocated);
+    }
+
+    bool add(const QString &token, int start, int end, bool colocated) override
+    {
+        const QByteArray bytes = token.toUtf8();
+        return emitToken(bytes.constData(), bytes.size(), offset(start), offset(end), colocated);
+    }
+
+    int res;
+
+private:
+    int offset(int pos) const
+    {
+        return offsets.at(qBound(0, pos, offsets.size() - 1));
+    }
+
+    bool emitToken(const char *token, int size, int start, int end, bool colocated)
+    {
+        if (res == SQLITE_OK && size > 0)
+            res = xToken(ctx, colocated ? FTS5_TOKEN_COLOCATED : 0, token, size, start, end);
+        return res == SQLITE_OK;
+    }
+
+    void *ctx;
+    int (*xToken)(void *, int, const char *, int, int, int);
+    const char *utf8;
+    QVector<int> offsets;
+};
+
+struct QSQLiteExFtsFilterContext
+{
+    QSQLiteExFtsInstance *instance;
+    void *ctx;
+    int (*xToken)(void *, int, const char *, int, int, int);
+};
+
+static int _q_fts_filter_token(void *pCtx, int tflags, const char *pToken, int nToken, int iStart, int iEnd)
+{
+    QSQLiteExFtsFilterContext *filterCtx = static_cast<QSQLiteExFtsFilterContext *>(pCtx);
+    QString token = QString::fromUtf8(pToken, nToken);
+    if (!filterCtx->instance->module->filter(token))
+        return SQLITE_OK;
+    const QByteArray bytes = token.toUtf8();
+    return filterCtx->xToken(filterCtx->ctx, tflags, bytes.constData(), bytes.size(), iStart, iEnd);
+}
+
+static int _q_fts_create(void *pCtx, const char **azArg, int nArg, Fts5Tokenizer **ppOut)
+{
+    QSQLiteExFtsModule *module = static_cast<QSQLiteExFtsModule *>(pCtx);
+    QByteArray key;
+    for (int i = 0; i < nArg; ++i)
+        key.append(azArg[i]).append('\0');
+
+    QSQLiteExFtsInstance *instance = module->instances.value(key);
+    if (instance) {
+        ++instance->ref;
+        *ppOut = reinterpret_cast<Fts5Tokenizer *>(instance);
+        return SQLITE_OK;
+    }
+
+    instance = new QSQLiteExFtsInstance;
+    instance->module = module;
+    instance->key = key;
+    instance->ref = 1;
+    instance->parentInstance = 0;
+    if (module->filter) {
+        // tokenize = '<filter> <parent tokenizer> <parent arguments>...'
+        void *parentCtx = 0;
+        int res = nArg < 1 ? SQLITE_ERROR
+                           : module->api->xFindTokenizer(module->api, azArg[0], &parentCtx, &instance->parent);
+        if (res == SQLITE_OK)
+            res = instance->parent.xCreate(parentCtx, azArg + 1, nArg - 1, &instance->parentInstance);
+        if (res != SQLITE_OK) {
+            delete instance;
+            return res;
+        }
+    }
+    module->instances.insert(key, instance);
+    *ppOut = reinterpret_cast<Fts5Tokenizer *>(instance);
+    return SQLITE_OK;
+}
+
+static void _q_fts_delete(Fts5Tokenizer *pTok)
+{
+    QSQLiteExFtsInstance *instance = reinterpret_cast<QSQLiteExFtsInstance *>(pTok);
+    if (--instance->ref > 0)
+        return;
+    instance->module->instances.remove(instance->key);
+    if (instance->parentInstance)
+        instance->parent.xDelete(instance->parentInstance);
+    delete instance;
+}
+
+static int _q_fts_tokenize(Fts5Tokenizer *pTok, void *pCtx, int flags, const char *pText, int nText,
+                           int (*xToken)(void *, int, const char *, int, int, int))
+{
+    QSQLiteExFtsInstance *instance = reinterpret_cast<QSQLiteExFtsInstance *>(pTok);
+    if (instance->parentInstance) {
+        QSQLiteExFtsFilterContext filterCtx = { instance, pCtx, xToken };
+        return instance->parent.xTokenize(instance->parentInstance, &filterCtx, flags, pText, nText,
+                                          &_q_fts_filter_token);
+    }
+
+    QSQLiteExFtsTokenSink sink(pCtx, xToken, pText, nText);
+    instance->module->tokenizer(QString::fromUtf8(pText, nText), flags, sink);
+    return sink.res;
+}
+
+static void _q_fts_destroy(void *module)
+{
+    delete static_cast<QSQLiteExFtsModule *>(module);
+}
+
+static fts5_api *qGetFts5Api(sqlite3 *access)
+{
+    fts5_api *api = 0;
+    sqlite3_stmt *stmt = 0;
+    if (sqlite3_prepare_v2(access, "SELECT fts5(?1)", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_pointer(stmt, 1, reinterpret_cast<void *>(&api), "fts5_api_ptr", NULL);
+        sqlite3_step(stmt);
+    }
+    sqlite3_finalize(stmt);
+    return api;
+}
+
+static int qCreateFtsTokenizer(sqlite3 *access, const QString &name, QSQLiteExFtsModule *module)
+{
+    module->api = qGetFts5Api(access);
+    if (!module->api) {
+        delete module;
+        return SQLITE_ERROR;
+    }
+    fts5_tokenizer tokenizer = { &_q_fts_create, &_q_fts_delete, &_q_fts_tokenize };
+    const int res = module->api->xCreateTokenizer(module->api, name.toUtf8().constData(), module,
+                                                  &tokenizer, &_q_fts_destroy);
+    // once registered, FTS5 owns the module and destroys it with the connection
+    if (res != SQLITE_OK)
+        delete module;
+    return res;
+}
+
+namespace QSQLiteExFunctionPrivate {
+
+qint64 valueInt64(sqlite3_value *value)
+{
+    return sqlite3_value_int64(value);
+}
+
+double valueDouble(sqlite3_value *value)
+{
+    return sqlite3_value_double(value);
+}
+
+const QChar *valueText16(sqlite3_value *value, int *size)
+{
+    const QChar *text = static_cast<const QChar *>(sqlite3_value_text16(value));
+    *size = sqlite3_value_bytes16(value) / int(sizeof(QChar));
+    return text;
+}
+
+const char *valueBlob(sqlite3_value *value, int *size)
+{
+    const char *data = static_cast<const char *>(sqlite3_value_blob(value));
+    *size = sqlite3_value_bytes(value);
+    return data;
+}
+
+void resultNull(sqlite3_context *context)
+{
+    sqlite3_result_null(context);
+}
+
+void resultInt64(sqlite3_context *context, qint64 value)
+{
+    sqlite3_result_int64(context, value);
+}
+
+void resultDouble(sqlite3_context *context, double value)
+{
+    sqlite3_result_double(context, value);
+}
+
+void resultText16(sqlite3_context *context, const QChar *text, int size)
+{
+    sqlite3_result_text16(context, text, size * int(sizeof(QChar)), SQLITE_TRANSIENT);
+}
+
+void resultBlob(sqlite3_context *context, const char *data, int size)
+{
+    sqlite3_result_blob(context, data, size, SQLITE_TRANSIENT);
+}
+
+void resultNoMem(sqlite3_context *context)
+{
+    sqlite3_result_error_nomem(context);
+}
+
+void *userData(sqlite3_context *context)
+{
+    return sqlite3_user_data(context);
+}
+
+void *aggregateContext(sqlite3_context *context, int size)
+{
+    return sqlite3_aggregate_context(context, size);
+}
+
+} // namespace QSQLiteExFunctionPrivate
+
+// a parsed CSV or JSONL value, text points into the file or into the chunk's storage
+struct QSQLiteExImportCell
+{
+    enum Kind { Null, Text, Integer, Real };
+    Kind kind;
+    int size;
+    union {
+        const char *text;
+        qint64 integer;
+        double real;
+    };
+};
+
+struct QSQLiteExImportChunk
+{
+    QVector<QSQLiteExImportCell> cells;
+    QVector<int> rowEnds;       // index in cells after each row
+    QList<QByteArray> storage;  // unescaped or converted text
+    QString error;
+};
+
+static inline void qAddImportText(QSQLiteExImportChunk *chunk, const char *text, int size)
+{
+    QSQLiteExImportCell cell;
+    cell.kind = QSQLiteExImportCell::Text;
+    cell.size = size;
+    cell.text = text;
+    chunk->cells.append(cell);
+}
+
+static inline void qAddImportText(QSQLiteExImportChunk *chunk, const QByteArray &text)
+{
+    chunk->storage.append(text);
+    qAddImportText(chunk, text.constData(), text.size());
+}
+
+// end of the first CSV record after target bytes, quoted fields may contain newlines
+static const char *qCsvChunkEnd(const char *p, const char *end, qint64 target)
+{
+    const char *limit = end - p > target ? p + target : end;
+    bool quoted = false;
+    while (p < end) {
+        if (quoted) {
+            p = static_cast<const char *>(memchr(p, '"', end - p));
+            if (!p)
+                return end;
+            quoted = false;
+        } else if (*p == '"') {
+            quoted = true;
+        } else if (*p == '\n' && p >= limit) {
+            return p + 1;
+        }
+        ++p;
+    }
+    return end;
+}
+
+static const char *qLineChunkEnd(const char *p, const char *end, qint64 target)
+{
+    if (end - p <= target)
+        return end;
+    const char *nl = static_cast<const char *>(memchr(p + target, '\n', end - p - target));
+    return nl ? nl + 1 : end;
+}
+
+// RFC 4180 records, cells are imported as text and converted by the column affinity.
+// An empty line is a record with one empty field, except for a trailing empty
+// line when end is the end of the input.
+static void qParseCsv(const char *p, const char *end, bool last, QSQLiteExImportChunk *chunk)
+{
+    while (p < end) {
+        if (last && (end - p == 1 ? *p == '\n' : end - p == 2 && p[0] == '\r' && p[1] == '\n'))
+            break;
+        forever {
+            if (p < end && *p == '"') {
+                const char *start = ++p;
+                bool escaped = false;
+                forever {
+                    const char *q = static_cast<const char *>(memchr(p, '"', end - p));
+                    if (!q) {
+                        p = end;
+                        break;
+                    }
+                    if (q + 1 < end && q[1] == '"') {
+                        escaped = true;
+                        p = q + 2;
+                        continue;
+                    }
+                    p = q;
+                    break;
+                }
+                if (escaped)
+                    qAddImportText(chunk, QByteArray(start, int(p - start)).replace("\"\"", "\""));
+                else
+                    qAddImportText(chunk, start, int(p - start));
+                if (p < end)
+                    ++p;
+                // ignore anything between the closing quote and the separator
+                while (p < end && *p != ',' && *p != '\n')
+                    ++p;
+            } else {
+                const char *start = p;
+                while (p < end && *p != ',' && *p != '\n')
+                    ++p;
+                const char *stop = p;
+                if (stop > start && stop[-1] == '\r' && (p == end || *p == '\n'))
+                    --stop;
+                qAddImportText(chunk, start, int(stop - start));
+            }
+            if (p < end && *p == ',') {
+                ++p;
+                continue;
+            }
+            if (p < end)
+                ++p;    // '\n'
+            break;
+        }
+        chunk->rowEnds.append(chunk->cells.size());
+    }
+}
+
+// one flat JSON object per line, values are looked up by column name
+static void qParseJsonLines(const char *p, const char *end, const QStringList &columns,
+                            QSQLiteExImportChunk *chunk)
+{
+    while (p < end) {
+        const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+        const char *stop = nl ? nl : end;
+        const QByteArray line = QByteArray::fromRawData(p, int(stop - p)).trimmed();
+        p = nl ? nl + 1 : end;
+        if (line.isEmpty())
+            continue;
+
+        QJsonParseError error;
+        const QJsonDocument doc = QJsonDocument::fromJson(line, &error);
+        if (!doc.isObject()) {
+            chunk->error = error.error != QJsonParseError::NoError ? error.errorString()
+                                                                   : QStringLiteral("line is not a JSON object");
+            return;
+        }
+        const QJsonObject object = doc.object();
+        for (const QString &column : columns) {
+            const QJsonValue value = object.value(column);
+            QSQLiteExImportCell cell;
+            cell.size = 0;
+            switch (value.type()) {
+            case QJsonValue::Bool:
+                cell.kind = QSQLiteExImportCell::Integer;
+                cell.integer = value.toBool();
+                break;
+            case QJsonValue::Double: {
+                const double d = value.toDouble();
+                if (d == std::floor(d) && std::fabs(d) < 9007199254740992.0) {
+                    cell.kind = QSQLiteExImportCell::Integer;
+                    cell.integer = qint64(d);
+                } else {
+                    cell.kind = QSQLiteExImportCell::Real;
+                    cell.real = d;
+                }
+                break;
+            }
+            case QJsonValue::String:
+                qAddImportText(chunk, value.toString().toUtf8());
+                continue;
+            case QJsonValue::Array:
+                qAddImportText(chunk, QJsonDocument(value.toArray()).toJson(QJsonDocument::Compact));
+                continue;
+            case QJsonValue::Object:
+                qAddImportText(chunk, QJsonDocument(value.toObject()).toJson(QJsonDocument::Compact));
+                continue;
+            default:
+                cell.kind = QSQLiteExImportCell::Null;
+                break;
+            }
+            chunk->cells.append(cell);
+        }
+        chunk->rowEnds.append(chunk->cells.size());
+    }
+}
+
+// Splits the file into chunks at record boundaries, parses them on worker
+// threads and hands them to the single writer in file order. At most
+// maxChunks chunks are in flight to bound memory.
+class QSQLiteExImportPipeline
+{
+public:
+    enum { ChunkSize = 4 * 1024 * 1024 };
+
+    QSQLiteExImportPipeline(const char *begin, const char *end, int format, const QStringList &columns,
+                            int maxChunks)
+        : next(begin), end(end), format(format), columns(columns), maxChunks(maxChunks),
+          taken(0), written(0), aborted(false) {}
+    ~QSQLiteExImportPipeline() { qDeleteAll(parsed); }
+
+    // parses the next chunk, returns false when there is nothing left
+    bool parseNext()
+    {
+        QMutexLocker locker(&mutex);
+        while (!aborted && next < end && taken - written >= maxChunks)
+            chunkTaken.wait(&mutex);
+        if (aborted || next >= end)
+            return false;
+        const char *start = next;
+        next = format == QSQLiteExDriver::Csv ? qCsvChunkEnd(start, end, ChunkSize)
+                                              : qLineChunkEnd(start, end, ChunkSize);
+        const char *stop = next;
+        const int index = taken++;
+        locker.unlock();
+
+        QSQLiteExImportChunk *chunk = new QSQLiteExImportChunk;
+        if (format == QSQLiteExDriver::Csv)
+            qParseCsv(start, stop, stop == end, chunk);
+        else
+            qParseJsonLines(start, stop, columns, chunk);
+
+        locker.relock();
+        parsed.insert(index, chunk);
+        chunkParsed.wakeAll();
+        return true;
+    }
+
+    // the next chunk in file order, 0 at the end
+    QSQLiteExImportChunk *take()
+    {
+        QMutexLocker locker(&mutex);
+        forever {
+            if (QSQLiteExImportChunk *chunk = parsed.take(written)) {
+                ++written;
+                chunkTaken.wakeAll();
+                return chunk;
+            }
+            if (aborted || (next >= end && written == taken))
+                return 0;
+            chunkParsed.wait(&mutex);
+        }
+    }
+
+    void abort()
+    {
+        QMutexLocker locker(&mutex);
+        aborted = true;
+        chunkParsed.wakeAll();
+        chunkTaken.wakeAll();
+    }
+
+private:
+    QMutex mutex;
+    QWaitCondition chunkParsed;
+    QWaitCondition chunkTaken;
+    const char *next;
+    const char *end;
+    const int format;
+    const QStringList columns;
+    const int maxChunks;
+    int taken;
+    int written;
+    bool aborted;
+    QHash<int, QSQLiteExImportChunk *> parsed;
+};
+
+class QSQLiteExImportWorker : public QThread
+{
+public:
+    explicit QSQLiteExImportWorker(QSQLiteExImportPipeline *pipeline) : pipeline(pipeline) {}
+
+protected:
+    void run() override
+    {
+        while (pipeline->parseNext()) {}
+    }
+
+private:
+    QSQLiteExImportPipeline *pipeline;
+};
+
+static QVariantMap qTransferStats(qint64 rows, qint64 bytes, qint64 msecs)
+{
+    const double seconds = qMax<qint64>(msecs, 1) / 1000.0;
+    QVariantMap stats;
+    stats.insert(QStringLiteral("rows"), rows);
+    stats.insert(QStringLiteral("bytes"), bytes);
+    stats.insert(QStringLiteral("msecs"), msecs);
+    stats.insert(QStringLiteral("rowsPerSecond"), rows / seconds);
+    stats.insert(QStringLiteral("megabytesPerSecond"), bytes / seconds / (1024 * 1024));
+    return stats;
+}
+
+static void qAppendCsv(QByteArray &out, const char *text, int size)
+{
+    bool quote = false;
+    for (int i = 0; i < size && !quote; ++i)
+        quote = text[i] == ',' || text[i] == '"' || text[i] == '\n' || text[i] == '\r';
+    if (!quote) {
+        out.append(text, size);
+        return;
+    }
+    out.append('"');
+    for (int i = 0; i < size; ++i) {
+        if (text[i] == '"')
+            out.append('"');
+        out.append(text[i]);
+    }
+    out.append('"');
+}
+
+static void qAppendJsonString(QByteArray &out, const char *text, int size)
+{
+    static const char hex[] = "0123456789abcdef";
+    out.append('"');
+    for (int i = 0; i < size; ++i) {
+        const uchar c = uchar(text[i]);
+        switch (c) {
+        case '"': out.append("\\\""); break;
+        case '\\': out.append("\\\\"); break;
+        case '\n': out.append("\\n"); break;
+        case '\r': out.append("\\r"); break;
+        case '\t': out.append("\\t"); break;
+        default:
+            if (c < 0x20) {
+                out.append("\\u00");
+                out.append(hex[c >> 4]);
+                out.append(hex[c & 0xf]);
+            } else {
+                out.append(char(c));
+            }
+        }
+    }
+    out.append('"');
+}
+
+// standard base64 with padding, encoded in place at the end of out
+static void qAppendBase64(QByteArray &out, const char *data, int size)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const int offset = out.size();
+    out.resize(offset + (size + 2) / 3 * 4);
+    char *o = out.data() + offset;
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    int i = 0;
+    for (; i + 2 < size; i += 3) {
+        const uint chunk = uint(p[i]) << 16 | uint(p[i + 1]) << 8 | p[i + 2];
+        *o++ = alphabet[chunk >> 18];
+        *o++ = alphabet[(chunk >> 12) & 0x3f];
+        *o++ = alphabet[(chunk >> 6) & 0x3f];
+        *o++ = alphabet[chunk & 0x3f];
+    }
+    if (i < size) {
+        const uint chunk = uint(p[i]) << 16 | (i + 1 < size ? uint(p[i + 1]) << 8 : 0);
+        *o++ = alphabet[chunk >> 18];
+        *o++ = alphabet[(chunk >> 12) & 0x3f];
+        *o++ = i + 1 < size ? alphabet[(chunk >> 6) & 0x3f] : '=';
+        *o++ = '=';
+    }
+}
+
+static qint64 qPragmaInt(sqlite3 *access, const char *pragma)
+{
+    qint64 value = -1;
+    sqlite3_stmt *stmt = 0;
+    if (sqlite3_prepare_v2(access, pragma, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+        value = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+static int qIncrementalVacuum(sqlite3 *access, int pages, qint64 *reclaimed, qint64 *freelistCount)
+{
+    const qint64 before = qPragmaInt(access, "PRAGMA freelist_count");
+    const int res = qExecSql(access, pages > 0 ? QStringLiteral("PRAGMA incremental_vacuum(%1)").arg(pages)
+                                               : QStringLiteral("PRAGMA incremental_vacuum"));
+    if (res != SQLITE_OK)
+        return res;
+    *freelistCount = qPragmaInt(access, "PRAGMA freelist_count");
+    *reclaimed = qMax<qint64>(before - *freelistCount, 0) * qPragmaInt(access, "PRAGMA page_size");
+    return SQLITE_OK;
+}
+
+// Runs index builds, ANALYZE and incremental_vacuum on its own connection so
+// the driver's connection stays responsive. SQLite admits one writer at a time,
+// so the index builds run one after the other and use the multi-threaded
+// sorter (PRAGMA threads) to spread the work over the cores.
+class QSQLiteExMaintenance : public QThread
+{
+public:
+    QSQLiteExMaintenance() : openFlags(0), sorterThreads(0), analysisLimit(0), fullAnalyze(false),
+        vacuumPages(0), access(0) {}
+
+    void cancel()
+    {
+        requestInterruption();
+        QMutexLocker locker(&mutex);
+        if (access)
+            sqlite3_interrupt(access);
+    }
+
+    QString databaseName;
+    QByteArray key;
+    int openFlags;
+    QStringList indexes;
+    int sorterThreads;
+    int analysisLimit;
+    bool fullAnalyze;
+    int vacuumPages;
+
+    QVariantMap report;
+    QString error;
+
+protected:
+    void run() override
+    {
+        QElapsedTimer total;
+        total.start();
+
+        sqlite3 *db = 0;
+        int res = sqlite3_open_v2(databaseName.toUtf8().constData(), &db,
+                                  (openFlags & ~(SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX)) | SQLITE_OPEN_NOMUTEX,
+                                  NULL);
+        if (res == SQLITE_OK)
+            res = sqlite3_key(db, key.constData(), key.size());
+        if (res != SQLITE_OK) {
+            error = QString(reinterpret_cast<const QChar *>(sqlite3_errmsg16(db)));
+            sqlite3_close(db);
+            report.insert(QStringLiteral("error"), error);
+            return;
+        }
+        sqlite3_busy_timeout(db, 60000);
+        {
+            QMutexLocker locker(&mutex);
+            access = db;
+        }
+
+        if (sorterThreads > 0)
+            execSql(QStringLiteral("PRAGMA threads = %1").arg(sorterThreads));
+
+        QElapsedTimer phase;
+        phase.start();
+        QVariantList builds;
+        for (const QString &sql : qAsConst(indexes)) {
+            if (!error.isEmpty() || isInterruptionRequested())
+                break;
+            QElapsedTimer timer;
+            timer.start();
+            execSql(sql);
+            QVariantMap build;
+            build.insert(QStringLiteral("sql"), sql);
+            build.insert(QStringLiteral("msecs"), timer.elapsed());
+            builds.append(build);
+        }
+        report.insert(QStringLiteral("indexes"), builds);
+        report.insert(QStringLiteral("indexMsecs"), phase.restart());
+
+        if (error.isEmpty() && !isInterruptionRequested()) {
+            if (analysisLimit > 0)
+                execSql(QStringLiteral("PRAGMA analysis_limit = %1").arg(analysisLimit));
+            if (error.isEmpty())
+                execSql(fullAnalyze ? QStringLiteral("ANALYZE") : QStringLiteral("PRAGMA optimize"));
+            report.insert(QStringLiteral("analyzeMsecs"), phase.restart());
+        }
+
+        // only frees pages with auto_vacuum = INCREMENTAL
+        if (vacuumPages != 0 && error.isEmpty() && !isInterruptionRequested()) {
+            const qint64 before = qPragmaInt(db, "PRAGMA freelist_count");
+            execSql(vacuumPages > 0 ? QStringLiteral("PRAGMA incremental_vacuum(%1)").arg(vacuumPages)
+                                 : QStringLiteral("PRAGMA incremental_vacuum"));
+            report.insert(QStringLiteral("pagesReclaimed"), before - qPragmaInt(db, "PRAGMA freelist_count"));
+            report.insert(QStringLiteral("vacuumMsecs"), phase.restart());
+        }
+
+        {
+            QMutexLocker locker(&mutex);
+            access = 0;
+        }
+        sqlite3_close(db);
+
+        if (error.isEmpty() && isInterruptionRequested())
+            error = QStringLiteral("interrupted");
+        if (!error.isEmpty())
+            report.insert(QStringLiteral("error"), error);
+        report.insert(QStringLiteral("totalMsecs"), total.elapsed());
+    }
+
+private:
+    void execSql(const QString &sql)
+    {
+        if (qExecSql(access, sql) != SQLITE_OK)
+            error = QString(reinterpret_cast<const QChar *>(sqlite3_errmsg16(access)));
+    }
+
+    QMutex mutex;
+    sqlite3 *access;
+};
+
+// read-only virtual table over the arrays of createArrayTable(), rowid is the array index
+struct QSQLiteExArrayVTab
+{
+    sqlite3_vtab base;
+    QSQLiteExArrayTable table;
+};
+
+struct QSQLiteExArrayCursor
+{
+    sqlite3_vtab_cursor base;
+    const QSQLiteExArrayTable *table;
+    qint64 row;
+    qint64 end;
+};
+
+// xBestIndex plan in idxNum: constraint flags, plus the column + 1 in the upper bits (0 is rowid)
+enum QSQLiteExArrayPlan {
+    ArrayEq = 0x01,
+    ArrayLower = 0x02,
+    ArrayLowerStrict = 0x04,
+    ArrayUpper = 0x08,
+    ArrayUpperStrict = 0x10,
+    ArrayColumnShift = 8
+};
+
+static inline const char *qArrayValue(const QSQLiteExArrayColumn &column, qint64 row)
+{
+    return static_cast<const char *>(column.data) + row * column.stride;
+}
+
+static bool qIsArrayNumeric(const QSQLiteExArrayColumn &column)
+{
+    return column.type == QSQLiteExArrayColumn::Int32 || column.type == QSQLiteExArrayColumn::Int64
+            || column.type == QSQLiteExArrayColumn::Double;
+}
+
+// constraint value of xFilter, with the text of QString columns converted once
+// instead of converting the column value on every comparison
+struct QSQLiteExArrayKey
+{
+    sqlite3_value *value;
+    QString string;
+};
+
+static QSQLiteExArrayKey qArrayKey(const QSQLiteExArrayColumn &column, sqlite3_value *value)
+{
+    QSQLiteExArrayKey key;
+    key.value = value;
+    if (column.type == QSQLiteExArrayColumn::String)
+        key.string = QString(reinterpret_cast<const QChar *>(sqlite3_value_text16(value)),
+                             sqlite3_value_bytes16(value) / int(sizeof(QChar)));
+    return key;
+}
+
+// UTF-16 compared in code point order, which is the byte order of UTF-8: surrogates
+// sort after U+E000..U+FFFF
+static int qCompareCodePoints(const QString &a, const QString &b)
+{
+    const ushort *p = a.utf16();
+    const ushort *q = b.utf16();
+    const int size = qMin(a.size(), b.size());
+    for (int i = 0; i < size; ++i) {
+        if (p[i] == q[i])
+            continue;
+        const uint x = p[i] >= 0xe000 ? p[i] - 0x800u : (p[i] >= 0xd800 ? p[i] + 0x2000u : p[i]);
+        const uint y = q[i] >= 0xe000 ? q[i] - 0x800u : (q[i] >= 0xd800 ? q[i] + 0x2000u : q[i]);
+        return x < y ? -1 : 1;
+    }
+    return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+}
+
+static int qCompareArrayValue(const QSQLiteExArrayColumn &column, qint64 row, const QSQLiteExArrayKey &key)
+{
+    const char *p = qArrayValue(column, row);
+    sqlite3_value *value = key.value;
+    switch (column.type) {
+    case QSQLiteExArrayColumn::Int32:
+    case QSQLiteExArrayColumn::Int64: {
+        const qint64 v = column.type == QSQLiteExArrayColumn::Int32
+                ? *reinterpret_cast<const int *>(p) : *reinterpret_cast<const qint64 *>(p);
+        if (sqlite3_value_type(value) == SQLITE_INTEGER) {
+            const qint64 other = sqlite3_value_int64(value);
+            return v < other ? -1 : (v > other ? 1 : 0);
+        }
+        const double other = sqlite3_value_double(value);
+        return double(v) < other ? -1 : (double(v) > other ? 1 : 0);
+    }
+    case QSQLiteExArrayColumn::Double: {
+        const double v = *reinterpret_cast<const double *>(p);
+        const double other = sqlite3_value_double(value);
+        return v < other ? -1 : (v > other ? 1 : 0);
+    }
+    case QSQLiteExArrayColumn::Utf8: {
+        const char *v = *reinterpret_cast<const char * const *>(p);
+        return v ? qstrcmp(v, reinterpret_cast<const char *>(sqlite3_value_text(value))) : -1;
+    }
+    case QSQLiteExArrayColumn::String: {
+        const QString &v = *reinterpret_cast<const QString *>(p);
+        return v.isNull() ? -1 : qCompareCodePoints(v, key.string);
+    }
+    }
+    return 0;
+}
+
+// first row in [begin, end) that compares greater (strict) or greater or equal to value
+static qint64 qArrayBound(const QSQLiteExArrayColumn &column, qint64 begin, qint64 end,
+                          const QSQLiteExArrayKey &key, bool strict)
+{
+    while (begin < end) {
+        const qint64 mid = begin + (end - begin) / 2;
+        const int cmp = qCompareArrayValue(column, mid, key);
+        if (cmp < 0 || (strict && cmp == 0))
+            begin = mid + 1;
+        else
+            end = mid;
+    }
+    return begin;
+}
+
+static int _q_array_connect(sqlite3 *db, void *aux, int argc, const char * const *argv,
+                            sqlite3_vtab **ppVTab, char **pzErr)
+{
+    const QHash<QString, QSQLiteExArrayTable> *tables = static_cast<const QHash<QString, QSQLiteExArrayTable> *>(aux);
+    const QString name = QString::fromUtf8(argc > 2 ? argv[2] : "");
+    const auto it = tables->constFind(name);
+    if (it == tables->constEnd()) {
+        *pzErr = sqlite3_mprintf("no arrays registered for table %s", argc > 2 ? argv[2] : "");
+        return SQLITE_ERROR;
+    }
+
+    QString schema = QLatin1String("CREATE TABLE x(");
+    for (int i = 0; i < it->columns.size(); ++i) {
+        const QSQLiteExArrayColumn &column = it->columns.at(i);
+        if (i)
+            schema += QLatin1Char(',');
+        schema += _q_escapeIdentifier(column.name);
+        switch (column.type) {
+        case QSQLiteExArrayColumn::Int32:
+        case QSQLiteExArrayColumn::Int64:
+            schema += QLatin1String(" INTEGER");
+            break;
+        case QSQLiteExArrayColumn::Double:
+            schema += QLatin1String(" REAL");
+            break;
+        default:
+            schema += QLatin1String(" TEXT");
+            break;
+        }
+    }
+    schema += QLatin1Char(')');
+    const int res = sqlite3_declare_vtab(db, schema.toUtf8().constData());
+    if (res != SQLITE_OK)
+        return res;
+
+    QSQLiteExArrayVTab *vtab = new QSQLiteExArrayVTab();
+    vtab->table = *it;
+    *ppVTab = &vtab->base;
+    return SQLITE_OK;
+}
+
+static int _q_array_disconnect(sqlite3_vtab *pVTab)
+{
+    delete reinterpret_cast<QSQLiteExArrayVTab *>(pVTab);
+    return SQLITE_OK;
+}
+
+static int _q_array_best_index(sqlite3_vtab *pVTab, sqlite3_index_info *info)
+{
+    const QSQLiteExArrayTable &table = reinterpret_cast<QSQLiteExArrayVTab *>(pVTab)->table;
+    const double rows = double(qMax<qint64>(table.rowCount, 1));
+
+    // pick a single column to search, an equality beats a range and rowid beats a column
+    int target = table.columns.size();
+    bool targetEq = false;
+    for (int i = 0; i < info->nConstraint; ++i) {
+        const sqlite3_index_info::sqlite3_index_constraint &c = info->aConstraint[i];
+        if (!c.usable || c.op > SQLITE_INDEX_CONSTRAINT_GE)
+            continue;
+        if (c.iColumn >= 0 && !table.columns.at(c.iColumn).sorted)
+            continue;
+        // text is sorted bytewise, so NOCASE, RTRIM or custom collations are left to SQLite
+        if (c.iColumn >= 0 && !qIsArrayNumeric(table.columns.at(c.iColumn))
+                && sqlite3_stricmp(sqlite3_vtab_collation(info, i), "BINARY") != 0)
+            continue;
+        const bool eq = c.op == SQLITE_INDEX_CONSTRAINT_EQ;
+        if (target == table.columns.size() || (eq && !targetEq) || (eq == targetEq && c.iColumn < target)) {
+            target = c.iColumn;
+            targetEq = eq;
+        }
+    }
+
+    int eq = -1, lower = -1, upper = -1;
+    if (target != table.columns.size()) {
+        for (int i = 0; i < info->nConstraint; ++i) {
+            const sqlite3_index_info::sqlite3_index_constraint &c = info->aConstraint[i];
+            if (!c.usable || c.iColumn != target)
+                continue;
+            if (target >= 0 && !qIsArrayNumeric(table.columns.at(target))
+                    && sqlite3_stricmp(sqlite3_vtab_collation(info, i), "BINARY") != 0)
+                continue;
+            if (c.op == SQLITE_INDEX_CONSTRAINT_EQ && eq < 0)
+                eq = i;
+            else if ((c.op == SQLITE_INDEX_CONSTRAINT_GT || c.op == SQLITE_INDEX_CONSTRAINT_GE) && lower < 0)
+                lower = i;
+            else if ((c.op == SQLITE_INDEX_CONSTRAINT_LT || c.op == SQLITE_INDEX_CONSTRAINT_LE) && upper < 0)
+                upper = i;
+        }
+    }
+
+    // SQLite still double checks the constraints, the search only narrows the rows
+    int plan = 0;
+    if (eq >= 0) {
+        plan = ArrayEq;
+        info->aConstraintUsage[eq].argvIndex = 1;
+        info->estimatedCost = target < 0 ? 1 : 1 + std::log2(rows);
+        info->estimatedRows = target < 0 ? 1 : 10;
+        if (target < 0)
+            info->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
+    } else if (lower >= 0 || upper >= 0) {
+        int argc = 0;
+        if (lower >= 0) {
+            plan |= info->aConstraint[lower].op == SQLITE_INDEX_CONSTRAINT_GT ? ArrayLowerStrict : ArrayLower;
+            info->aConstraintUsage[lower].argvIndex = ++argc;
+        }
+        if (upper >= 0) {
+            plan |= info->aConstraint[upper].op == SQLITE_INDEX_CONSTRAINT_LT ? ArrayUpperStrict : ArrayUpper;
+            info->aConstraintUsage[upper].argvIndex = ++argc;
+        }
+        const double fraction = argc == 2 ? 0.125 : 0.33;
+        info->estimatedCost = std::log2(rows) + rows * fraction;
+        info->estimatedRows = qMax<sqlite3_int64>(1, sqlite3_int64(rows * fraction));
+    } else {
+        info->estimatedCost = rows;
+        info->estimatedRows = table.rowCount;
+    }
+    if (plan)
+        plan |= (target + 1) << ArrayColumnShift;
+    info->idxNum = plan;
+
+    // rows are visited in array order, which is also the order of every sorted column
+    if (info->nOrderBy == 1 && !info->aOrderBy[0].desc
+            && (info->aOrderBy[0].iColumn < 0 || table.columns.at(info->aOrderBy[0].iColumn).sorted))
+        info->orderByConsumed = 1;
+    return SQLITE_OK;
+}
+
+static int _q_array_open(sqlite3_vtab *pVTab, sqlite3_vtab_cursor **ppCursor)
+{
+    QSQLiteExArrayCursor *cursor = new QSQLiteExArrayCursor();
+    cursor->table = &reinterpret_cast<QSQLiteExArrayVTab *>(pVTab)->table;
+    *ppCursor = &cursor->base;
+    return SQLITE_OK;
+}
+
+static int _q_array_close(sqlite3_vtab_cursor *pCursor)
+{
+    delete reinterpret_cast<QSQLiteExArrayCursor *>(pCursor);
+    return SQLITE_OK;
+}
+
+static int _q_array_filter(sqlite3_vtab_cursor *pCursor, int idxNum, const char *, int argc, sqlite3_value **argv)
+{
+    QSQLiteExArrayCursor *cursor = reinterpret_cast<QSQLiteExArrayCursor *>(pCursor);
+    qint64 begin = 0;
+    qint64 end = cursor->table->rowCount;
+    const int target = (idxNum >> ArrayColumnShift) - 1;
+
+    // lower bound first, then upper bound, as handed out in xBestIndex
+    sqlite3_value *lower = 0, *upper = 0;
+    bool lowerStrict = false, upperStrict = false;
+    if (idxNum & ArrayEq) {
+        lower = upper = argv[0];
+    } else {
+        int i = 0;
+        if (idxNum & (ArrayLower | ArrayLowerStrict)) {
+            lower = argv[i++];
+            lowerStrict = idxNum & ArrayLowerStrict;
+        }
+        if (idxNum & (ArrayUpper | ArrayUpperStrict)) {
+            upper = argv[i++];
+            upperStrict = idxNum & ArrayUpperStrict;
+        }
+        Q_ASSERT(i == argc);
+    }
+    Q_UNUSED(argc);
+
+    if (idxNum && target < 0) {
+        // rowid, only narrow on integers and leave everything else to SQLite; bounds at or
+        // past the end are clamped first so that INT64_MAX + 1 cannot overflow
+        if (lower && sqlite3_value_type(lower) == SQLITE_INTEGER) {
+            const qint64 value = sqlite3_value_int64(lower);
+            begin = qMax(begin, value >= end ? end : value + (lowerStrict ? 1 : 0));
+        }
+        if (upper && sqlite3_value_type(upper) == SQLITE_INTEGER) {
+            const qint64 value = sqlite3_value_int64(upper);
+            end = qMin(end, value >= end ? end : value + (upperStrict ? 0 : 1));
+        }
+    } else if (idxNum) {
+        const QSQLiteExArrayColumn &column = cursor->table->columns.at(target);
+        const int wanted = qIsArrayNumeric(column) ? -1 : SQLITE_TEXT;
+        const auto comparable = [wanted](sqlite3_value *value) {
+            const int type = sqlite3_value_type(value);
+            return wanted == SQLITE_TEXT ? type == SQLITE_TEXT : (type == SQLITE_INTEGER || type == SQLITE_FLOAT);
+        };
+        if (lower && sqlite3_value_type(lower) == SQLITE_NULL) {
+            end = 0;        // comparisons with NULL never match
+        } else if (upper && sqlite3_value_type(upper) == SQLITE_NULL) {
+            end = 0;
+        } else {
+            if (lower && comparable(lower))
+                begin = qArrayBound(column, begin, end, qArrayKey(column, lower), lowerStrict);
+            if (upper && comparable(upper))
+                end = qArrayBound(column, begin, end, qArrayKey(column, upper), !upperStrict);
+        }
+    }
+
+    cursor->row = qMax<qint64>(begin, 0);
+    cursor->end = qMax(end, cursor->row);
+    return SQLITE_OK;
+}
+
+static int _q_array_next(sqlite3_vtab_cursor *pCursor)
+{
+    ++reinterpret_cast<QSQLiteExArrayCursor *>(pCursor)->row;
+    return SQLITE_OK;
+}
+
+static int _q_array_eof(sqlite3_vtab_cursor *pCursor)
+{
+    const QSQLiteExArrayCursor *cursor = reinterpret_cast<QSQLiteExArrayCursor *>(pCursor);
+    return cursor->row >= cursor->end;
+}
+
+static int _q_array_column(sqlite3_vtab_cursor *pCursor, sqlite3_context *context, int i)
+{
+    const QSQLiteExArrayCursor *cursor = reinterpret_cast<QSQLiteExArrayCursor *>(pCursor);
+    const QSQLiteExArrayColumn &column = cursor->table->columns.at(i);
+    const char *p = qArrayValue(column, cursor->row);
+    switch (column.type) {
+    case QSQLiteExArrayColumn::Int32:
+        sqlite3_result_int(context, *reinterpret_cast<const int *>(p));
+        break;
+    case QSQLiteExArrayColumn::Int64:
+        sqlite3_result_int64(context, *reinterpret_cast<const qint64 *>(p));
+        break;
+    case QSQLiteExArrayColumn::Double:
+        sqlite3_result_double(context, *reinterpret_cast<const double *>(p));
+        break;
+    case QSQLiteExArrayColumn::Utf8: {
+        // the arrays outlive the table, so the text is handed over without a copy
+        const char *v = *reinterpret_cast<const char * const *>(p);
+        if (v)
+            sqlite3_result_text(context, v, -1, SQLITE_STATIC);
+        else
+            sqlite3_result_null(context);
+        break;
+    }
+    case QSQLiteExArrayColumn::String: {
+        const QString &v = *reinterpret_cast<const QString *>(p);
+        if (v.isNull())
+            sqlite3_result_null(context);
+        else
+            sqlite3_result_text16(context, v.constData(), v.size() * int(sizeof(QChar)), SQLITE_STATIC);
+        break;
+    }
+    }
+    return SQLITE_OK;
+}
+
+static int _q_array_rowid(sqlite3_vtab_cursor *pCursor, sqlite3_int64 *pRowid)
+{
+    *pRowid = reinterpret_cast<QSQLiteExArrayCursor *>(pCursor)->row;
+    return SQLITE_OK;
+}
+
+static const sqlite3_module qArrayModule = {
+    0,                      // iVersion
+    &_q_array_connect,      // xCreate
+    &_q_array_connect,      // xConnect
+    &_q_array_best_index,
+    &_q_array_disconnect,
+    &_q_array_disconnect,   // xDestroy
+    &_q_array_open,
+    &_q_array_close,
+    &_q_array_filter,
+    &_q_array_next,
+    &_q_array_eof,
+    &_q_array_column,
+    &_q_array_rowid,
+    0                       // no xUpdate, read-only
+};
+
 QSQLiteExDriver::QSQLiteExDriver(QObject * parent)
     : QSqlDriver(*new QSQLiteExDriverPrivate, parent)
 {
 }
 
-QSQLiteExDriver::QSQLiteExDriver(sqlite3 *connection, QObject *parent)
-    : QSqlDriver(*new QSQLiteExDriverPrivate, parent)
+QSQLiteExDriver::QSQLiteExDriver(sqlite3 *connection, QObject *parent)
+    : QSqlDriver(*new QSQLiteExDriverPrivate, parent)
+{
+    Q_D(QSQLiteExDriver);
+    d->access = connection;
+    setOpen(true);
+    setOpenError(false);
+}
+
+
+QSQLiteExDriver::~QSQLiteExDriver()
+{
+    close();
+}
+
+bool QSQLiteExDriver::hasFeature(DriverFeature f) const
+{
+    switch (f) {
+    case BLOB:
+    case Transactions:
+    case Unicode:
+    case LastInsertId:
+    case PreparedQueries:
+    case PositionalPlaceholders:
+    case SimpleLocking:
+    case FinishQuery:
+    case LowPrecisionNumbers:
+    case EventNotifications:
+        return true;
+    case QuerySize:
+    case BatchOperations:
+    case MultipleResultSets:
+    case CancelQuery:
+        return false;
+    case NamedPlaceholders:
+#if (SQLITE_VERSION_NUMBER < 3003011)
+        return false;
+#else
+        return true;
+#endif
+
+    }
+    return false;
+}
+
+/*
+   SQLite dbs have no user name, passwords, hosts or ports.
+   just file names.
+   changes: using user and password to encryption the db
+*/
+bool QSQLiteExDriver::open(const QString &db, const QString &user, const QString &password, const QString &host, int port, const QString &conOpts)
+{
+    Q_UNUSED(user)
+    Q_UNUSED(password)
+    Q_UNUSED(host)
+    Q_UNUSED(port)
+
+    Q_D(QSQLiteExDriver);
+    if (isOpen())
+        close();
+
+
+    int timeOut = 5000;
+    bool sharedCache = false;
+    bool openReadOnlyOption = false;
+    bool openUriOption = false;
+    bool immutable = false;
+    int readAheadRows = 0;
+    QSQLiteExDriverPrivate::DateTimeEncoding dateTimeEncoding = QSQLiteExDriverPrivate::IsoDateTime;
+    int vacuumSlice = 0;
+    int vacuumInterval = 1000;
+    int lookasideSize = -1;
+    int lookasideCount = -1;
+    qint64 softHeapLimit = -1;
+    // applied once the key is set
+    QStringList pragmas;
+#ifdef QSQLITEEX_REGEXP
+    static const QLatin1String regexpConnectOption = QLatin1String("QSQLITE_ENABLE_REGEXP");
+    bool defineRegexp = false;
+    int regexpCacheSize = 25;
+#endif
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    const auto opts = QStringView(conOpts).split(u';');
+#elif QT_VERSION >= QT_VERSION_CHECK(5, 9, 0)
+    const auto opts = conOpts.splitRef(QLatin1Char(';'));
+#else
+    // QStringRef::trimmed() is missing before 5.9
+    const QStringList opts = conOpts.split(QLatin1Char(';'));
+#endif
+    for (auto option : opts) {
+        option = option.trimmed();
+        if (option.startsWith(QLatin1String("QSQLITE_BUSY_TIMEOUT"))) {
+            option = option.mid(20).trimmed();
+            if (option.startsWith(QLatin1Char('='))) {
+                bool ok;
+                const int nt = option.mid(1).trimmed().toInt(&ok);
+                if (ok)
+                    timeOut = nt;
+            }
+        } else if (option == QLatin1String("QSQLITE_OPEN_READONLY")) {
+            openReadOnlyOption = true;
+        } else if (option == QLatin1String("QSQLITE_OPEN_URI")) {
+            openUriOption = true;
+        } else if (option == QLatin1String("QSQLITE_ENABLE_SHARED_CACHE")) {
+            sharedCache = true;
+        } else if (option == QLatin1String("QSQLITE_IMMUTABLE")) {
+            immutable = true;
+        } else if (option.startsWith(QLatin1String("QSQLITE_MMAP_SIZE"))) {
+            option = option.mid(17).trimmed();
+            if (option.startsWith(QLatin1Char('='))) {
+                bool ok;
+                const qint64 bytes = option.mid(1).trimmed().toLongLong(&ok);
+                if (ok)
+                    pragmas.append(QLatin1String("PRAGMA mmap_size = ") + QString::number(bytes));
+            }
+        } else if (option.startsWith(QLatin1String("QSQLITE_READ_AHEAD"))) {
+            option = option.mid(18).trimmed();
+            if (option.startsWith(QLatin1Char('='))) {
+                bool ok;
+                const int rows = option.mid(1).trimmed().toInt(&ok);
+                if (ok)
+                    readAheadRows = qMax(rows, 0);
+            }
+        } else if (option.startsWith(QLatin1String("QSQLITE_AUTO_VACUUM"))) {
+            option = option.mid(19).trimmed();
+            if (option.startsWith(QLatin1Char('='))) {
+                option = option.mid(1).trimmed();
+                if (option == QLatin1String("NONE") || option == QLatin1String("FULL")
+                        || option == QLatin1String("INCREMENTAL"))
+                    pragmas.append(QLatin1String("PRAGMA auto_vacuum = ")
+                                   + QString(option.constData(), option.size()));
+            }
+        } else if (option.startsWith(QLatin1String("QSQLITE_SECURE_DELETE"))) {
+            option = option.mid(21).trimmed();
+            if (option.startsWith(QLatin1Char('='))) {
+                option = option.mid(1).trimmed();
+                if (option == QLatin1String("ON") || option == QLatin1String("OFF")
+                        || option == QLatin1String("FAST"))
+                    pragmas.append(QLatin1String("PRAGMA secure_delete = ")
+                                   + QString(option.constData(), option.size()));
+            }
+        } else if (option.startsWith(QLatin1String("QSQLITE_CACHE_SIZE"))) {
+            option = option.mid(18).trimmed();
+            if (option.startsWith(QLatin1Char('='))) {
+                bool ok;
+                const int pages = option.mid(1).trimmed().toInt(&ok);
+                if (ok)
+                    pragmas.append(QLatin1String("PRAGMA cache_size = ") + QString::number(pages));
+            }
+        } else if (option.startsWith(QLatin1String("QSQLITE_LOOKASIDE"))) {
+            option = option.mid(17).trimmed();
+            if (option.startsWith(QLatin1Char('='))) {
+                const auto values = option.mid(1).split(QLatin1Char(','));
+                bool sizeOk = false, countOk = false;
+                if (values.size() == 2) {
+                    lookasideSize = values.at(0).trimmed().toInt(&sizeOk);
+                    lookasideCount = values.at(1).trimmed().toInt(&countOk);
+                }
+                if (!sizeOk || !countOk || lookasideSize < 0 || lookasideCount < 0) {
+                    qWarning("QSQLITE_LOOKASIDE ignored, expected <slot size>,<slots>.");
+                    lookasideSize = lookasideCount = -1;
+                }
+            }
+        } else if (option.startsWith(QLatin1String("QSQLITE_SOFT_HEAP_LIMIT"))) {
+            option = option.mid(23).trimmed();
+            if (option.startsWith(QLatin1Char('='))) {
+                bool ok;
+                const qint64 bytes = option.mid(1).trimmed().toLongLong(&ok);
+                if (ok)
+                    softHeapLimit = bytes;
+            }
+        } else if (option.startsWith(QLatin1String("QSQLITE_VACUUM_SLICE"))) {
+            option = option.mid(20).trimmed();
+            if (option.startsWith(QLatin1Char('='))) {
+                bool ok;
+                const int pages = option.mid(1).trimmed().toInt(&ok);
+                if (ok)
+                    vacuumSlice = qMax(pages, 0);
+            }
+        } else if (option.startsWith(QLatin1String("QSQLITE_VACUUM_INTERVAL"))) {
+            option = option.mid(23).trimmed();
+            if (option.startsWith(QLatin1Char('='))) {
+                bool ok;
+                const int msecs = option.mid(1).trimmed().toInt(&ok);
+                if (ok && msecs > 0)
+                    vacuumInterval = msecs;
+            }
+        } else if (option.startsWith(QLatin1String("QSQLITE_DATETIME_ENCODING"))) {
+            option = option.mid(25).trimmed();
+            if (option.startsWith(QLatin1Char('='))) {
+                option = option.mid(1).trimmed();
+                if (option == QLatin1String("ISO"))
+                    dateTimeEncoding = QSQLiteExDriverPrivate::IsoDateTime;
+                else if (option == QLatin1String("EPOCH"))
+                    dateTimeEncoding = QSQLiteExDriverPrivate::EpochSeconds;
+                else if (option == QLatin1String("EPOCH_MS"))
+                    dateTimeEncoding = QSQLiteExDriverPrivate::EpochMSecs;
+            }
+        }
+#ifdef QSQLITEEX_REGEXP
+        else if (option.startsWith(regexpConnectOption)) {
+            option = option.mid(regexpConnectOption.size()).trimmed();
+            if (option.isEmpty()) {
+                defineRegexp = true;
+            } else if (option.startsWith(QLatin1Char('='))) {
+                bool ok = false;
+                const int cacheSize = option.mid(1).trimmed().toInt(&ok);
+                if (ok) {
+                    defineRegexp = true;
+                    if (cacheSize > 0)
+                        regexpCacheSize = cacheSize;
+                }
+            }
+        }
+#endif
+    }
+
+    // immutable=1 tells SQLite the file never changes: no file locks and no
+    // change counter checks, so any number of processes can read it at once
+    QString fileName = db;
+    if (immutable && !db.isEmpty() && db != QLatin1String(":memory:")) {
+        if (openUriOption && db.startsWith(QLatin1String("file:")))
+            fileName += QLatin1Char(db.contains(QLatin1Char('?')) ? '&' : '?');
+        else
+            fileName = QUrl::fromLocalFile(db).toString(QUrl::FullyEncoded) + QLatin1Char('?');
+        fileName += QLatin1String("immutable=1");
+        openReadOnlyOption = openUriOption = true;
+    }
+
+    int openMode = (openReadOnlyOption ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE));
+    openMode |= (sharedCache ? SQLITE_OPEN_SHAREDCACHE : SQLITE_OPEN_PRIVATECACHE);
+    if (openUriOption)
+        openMode |= SQLITE_OPEN_URI;
+
+    // the read-ahead thread steps statements concurrently with the owning thread
+    openMode |= (readAheadRows > 0 ? SQLITE_OPEN_FULLMUTEX : SQLITE_OPEN_NOMUTEX);
+
+    const int res = sqlite3_open_v2(fileName.toUtf8().constData(), &d->access, openMode, NULL);
+
+    // lookaside can only be changed before the connection allocates from it,
+    // SQLITE_BUSY means it already has
+    if (res == SQLITE_OK && lookasideSize >= 0) {
+        const int lookasideRes = sqlite3_db_config(d->access, SQLITE_DBCONFIG_LOOKASIDE, NULL,
+                                                   lookasideSize, lookasideCount);
+        if (lookasideRes != SQLITE_OK) {
+            setLastError(qMakeError(d->access, tr("Error applying connect options"),
+                         QSqlError::ConnectionError, lookasideRes));
+            setOpenError(true);
+            sqlite3_close(d->access);
+            d->access = 0;
+            return false;
+        }
+    }
+
+    if (res == SQLITE_OK) {
+        if(sqlite3_key(d->access,password.toUtf8(), password.toUtf8().length()) != SQLITE_OK)
+        {
+            if (d->access) {
+                sqlite3_close(d->access);
+                d->access = 0;
+            }
+            setLastError(qMakeError(d->access, tr("Error opening database by key"),
+                         QSqlError::ConnectionError, res));
+            setOpenError(true);
+            return false;
+        }
+    }
+
+    if (res == SQLITE_OK)
+        sqlite3_busy_timeout(d->access, timeOut);
+
+    for (int i = 0; i < pragmas.size() && res == SQLITE_OK; ++i) {
+        const int pragmaRes = qExecSql(d->access, pragmas.at(i));
+        if (pragmaRes != SQLITE_OK) {
+            setLastError(qMakeError(d->access, tr("Error applying connect options"),
+                         QSqlError::ConnectionError, pragmaRes));
+            setOpenError(true);
+            sqlite3_close(d->access);
+            d->access = 0;
+            return false;
+        }
+    }
+
+    // read the schema now rather than on the first query, which also checks the key
+    if (res == SQLITE_OK && immutable) {
+        const int schemaRes = qExecSql(d->access, QLatin1String("SELECT count(*) FROM sqlite_master"));
+        if (schemaRes != SQLITE_OK) {
+            setLastError(qMakeError(d->access, tr("Unable to read database schema"),
+                         QSqlError::ConnectionError, schemaRes));
+            setOpenError(true);
+            sqlite3_close(d->access);
+            d->access = 0;
+            return false;
+        }
+    }
+
+    if (res == SQLITE_OK) {
+        d->readAheadRows = readAheadRows;
+        d->dateTimeEncoding = dateTimeEncoding;
+        d->databaseName = fileName;
+        d->key = password.toUtf8();
+        d->openFlags = openMode;
+        d->busyTimeout = timeOut;
+        // process wide, applies to all connections, so only set by a successful open
+        if (softHeapLimit >= 0)
+            sqlite3_soft_heap_limit64(softHeapLimit);
+        setOpen(true);
+        setOpenError(false);
+        // incremental_vacuum does nothing unless auto_vacuum is INCREMENTAL (2)
+        if (vacuumSlice > 0 && qPragmaInt(d->access, "PRAGMA auto_vacuum") != 2) {
+            qWarning("QSQLITE_VACUUM_SLICE ignored, auto_vacuum is not INCREMENTAL.");
+        } else if (vacuumSlice > 0) {
+            d->vacuumSlice = vacuumSlice;
+            d->vacuumTimer = new QTimer(this);
+            connect(d->vacuumTimer, &QTimer::timeout, this, [this]() {
+                Q_D(QSQLiteExDriver);
+                if (!d->isIdle() || qPragmaInt(d->access, "PRAGMA freelist_count") <= 0)
+                    return;
+                // skip the slice if another connection writes instead of waiting for it
+                sqlite3_busy_timeout(d->access, 0);
+                qint64 reclaimed = 0;
+                qint64 freelistCount = 0;
+                const int res = qIncrementalVacuum(d->access, d->vacuumSlice, &reclaimed, &freelistCount);
+                sqlite3_busy_timeout(d->access, d->busyTimeout);
+                if (res == SQLITE_OK && reclaimed > 0)
+                    emit spaceReclaimed(reclaimed, freelistCount);
+            });
+            d->vacuumTimer->start(vacuumInterval);
+        }
+#ifdef QSQLITEEX_REGEXP
+        if (defineRegexp) {
+            auto cache = new QSQLiteExRegexpCache(regexpCacheSize);
+            sqlite3_create_function_v2(d->access, "regexp", 2, SQLITE_UTF16 | SQLITE_DETERMINISTIC, cache,
+                                       &_q_regexp, NULL, NULL, &_q_regexp_cleanup);
+        }
+#endif
+        return true;
+    } else {
+        setLastError(qMakeError(d->access, tr("Error opening database"),
+                     QSqlError::ConnectionError, res));
+        setOpenError(true);
+
+        if (d->access) {
+            sqlite3_close(d->access);
+            d->access = 0;
+        }
+
+        return false;
+    }
+}
+
+void QSQLiteExDriver::close()
+{
+    Q_D(QSQLiteExDriver);
+    if (isOpen()) {
+        delete d->vacuumTimer;
+        d->vacuumTimer = 0;
+        d->vacuumSlice = 0;
+
+        if (d->maintenance) {
+            d->maintenance->cancel();
+            d->maintenance->wait();
+            delete d->maintenance;
+            d->maintenance = 0;
+        }
+
+        for (QSQLiteExResult *result : qAsConst(d->results))
+            result->d_func()->finalize();
+
+        if (d->access && (d->notificationid.count() > 0)) {
+            d->notificationid.clear();
+            sqlite3_update_hook(d->access, NULL, NULL);
+        }
+
+        const int res = sqlite3_close(d->access);
+
+        if (res != SQLITE_OK)
+            setLastError(qMakeError(d->access, tr("Error closing database"), QSqlError::ConnectionError, res));
+        d->access = 0;
+        d->images.clear();
+        d->arrayTables.clear();
+        d->arrayModule = false;
+        d->databaseName.clear();
+        d->key.clear();
+        setOpen(false);
+        setOpenError(false);
+    }
+}
+
+QSqlResult *QSQLiteExDriver::createResult() const
+{
+    return new QSQLiteExResult(this);
+}
+
+bool QSQLiteExDriver::beginTransaction()
+{
+    if (!isOpen() || isOpenError())
+        return false;
+
+    QSqlQuery q(createResult());
+    if (!q.exec(QLatin1String("BEGIN"))) {
+        setLastError(QSqlError(tr("Unable to begin transaction"),
+                               q.lastError().databaseText(), QSqlError::TransactionError));
+        return false;
+    }
+
+    return true;
+}
+
+bool QSQLiteExDriver::commitTransaction()
+{
+    if (!isOpen() || isOpenError())
+        return false;
+
+    QSqlQuery q(createResult());
+    if (!q.exec(QLatin1String("COMMIT"))) {
+        setLastError(QSqlError(tr("Unable to commit transaction"),
+                               q.lastError().databaseText(), QSqlError::TransactionError));
+        return false;
+    }
+
+    return true;
+}
+
+bool QSQLiteExDriver::rollbackTransaction()
+{
+    if (!isOpen() || isOpenError())
+        return false;
+
+    QSqlQuery q(createResult());
+    if (!q.exec(QLatin1String("ROLLBACK"))) {
+        setLastError(QSqlError(tr("Unable to rollback transaction"),
+                               q.lastError().databaseText(), QSqlError::TransactionError));
+        return false;
+    }
+
+    return true;
+}
+
+QStringList QSQLiteExDriver::tables(QSql::TableType type) const
+{
+    QStringList res;
+    if (!isOpen())
+        return res;
+
+    QSqlQuery q(createResult());
+    q.setForwardOnly(true);
+
+    QString sql = QLatin1String("SELECT name FROM sqlite_master WHERE %1 "
+                                "UNION ALL SELECT name FROM sqlite_temp_master WHERE %1");
+    if ((type & QSql::Tables) && (type & QSql::Views))
+        sql = sql.arg(QLatin1String("type='table' OR type='view'"));
+    else if (type & QSql::Tables)
+        sql = sql.arg(QLatin1String("type='table'"));
+    else if (type & QSql::Views)
+        sql = sql.arg(QLatin1String("type='view'"));
+    else
+        sql.clear();
+
+    if (!sql.isEmpty() && q.exec(sql)) {
+        while(q.next())
+            res.append(q.value(0).toString());
+    }
+
+    if (type & QSql::SystemTables) {
+        // there are no internal tables beside this one:
+        res.append(QLatin1String("sqlite_master"));
+    }
+
+    return res;
+}
+
+static QSqlIndex qGetTableInfo(QSqlQuery &q, const QString &tableName, bool onlyPIndex = false)
+{
+    QString schema;
+    QString table(tableName);
+    int indexOfSeparator = tableName.indexOf(QLatin1Char('.'));
+    if (indexOfSeparator > -1) {
+        schema = tableName.left(indexOfSeparator).append(QLatin1Char('.'));
+        table = tableName.mid(indexOfSeparator + 1);
+    }
+    q.exec(QLatin1String("PRAGMA ") + schema + QLatin1String("table_info (") + _q_escapeIdentifier(table) + QLatin1Char(')'));
+
+    QSqlIndex ind;
+    while (q.next()) {
+        bool isPk = q.value(5).toInt();
+        if (onlyPIndex && !isPk)
+            continue;
+        QString typeName = q.value(2).toString().toLower();
+        QString defVal = q.value(4).toString();
+        if (!defVal.isEmpty() && defVal.at(0) == QLatin1Char('\'')) {
+            const int end = defVal.lastIndexOf(QLatin1Char('\''));
+            if (end > 0)
+                defVal = defVal.mid(1, end - 1);
+        }
+
+        QSqlField fld = qMakeField(q.value(1).toString(), qGetColumnType(typeName), tableName);
+        if (isPk && (typeName == QLatin1String("integer")))
+            // INTEGER PRIMARY KEY fields are auto-generated in sqlite
+            // INT PRIMARY KEY is not the same as INTEGER PRIMARY KEY!
+            fld.setAutoValue(true);
+        fld.setRequired(q.value(3).toInt() != 0);
+        fld.setDefaultValue(defVal);
+        ind.append(fld);
+    }
+    return ind;
+}
+
+QSqlIndex QSQLiteExDriver::primaryIndex(const QString &tblname) const
+{
+    if (!isOpen())
+        return QSqlIndex();
+
+    QString table = tblname;
+    if (isIdentifierEscaped(table, QSqlDriver::TableName))
+        table = stripDelimiters(table, QSqlDriver::TableName);
+
+    QSqlQuery q(createResult());
+    q.setForwardOnly(true);
+    return qGetTableInfo(q, table, true);
+}
+
+QSqlRecord QSQLiteExDriver::record(const QString &tbl) const
+{
+    if (!isOpen())
+        return QSqlRecord();
+
+    QString table = tbl;
+    if (isIdentifierEscaped(table, QSqlDriver::TableName))
+        table = stripDelimiters(table, QSqlDriver::TableName);
+
+    QSqlQuery q(createResult());
+    q.setForwardOnly(true);
+    return qGetTableInfo(q, table);
+}
+
+QVariant QSQLiteExDriver::handle() const
+{
+    Q_D(const QSQLiteExDriver);
+    return QVariant::fromValue(d->access);
+}
+
+QString QSQLiteExDriver::escapeIdentifier(const QString &identifier, IdentifierType type) const
+{
+    Q_UNUSED(type);
+    return _q_escapeIdentifier(identifier);
+}
+
+static void handle_sqlite_callback(void *qobj,int aoperation, char const *adbname, char const *atablename,
+                                   sqlite3_int64 arowid)
+{
+    Q_UNUSED(aoperation);
+    Q_UNUSED(adbname);
+    QSQLiteExDriver *driver = static_cast<QSQLiteExDriver *>(qobj);
+    if (driver) {
+        QMetaObject::invokeMethod(driver, "handleNotification", Qt::QueuedConnection,
+                                  Q_ARG(QString, QString::fromUtf8(atablename)), Q_ARG(qint64, arowid));
+    }
+}
+
+bool QSQLiteExDriver::subscribeToNotification(const QString &name)
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen()) {
+        qWarning("Database not open.");
+        return false;
+    }
+
+    if (d->notificationid.contains(name)) {
+        qWarning("Already subscribing to '%s'.", qPrintable(name));
+        return false;
+    }
+
+    //sqlite supports only one notification callback, so only the first is registered
+    d->notificationid << name;
+    if (d->notificationid.count() == 1)
+        sqlite3_update_hook(d->access, &handle_sqlite_callback, reinterpret_cast<void *> (this));
+
+    return true;
+}
+
+bool QSQLiteExDriver::unsubscribeFromNotification(const QString &name)
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen()) {
+        qWarning("Database not open.");
+        return false;
+    }
+
+    if (!d->notificationid.contains(name)) {
+        qWarning("Not subscribed to '%s'.", qPrintable(name));
+        return false;
+    }
+
+    d->notificationid.removeAll(name);
+    if (d->notificationid.isEmpty())
+        sqlite3_update_hook(d->access, NULL, NULL);
+
+    return true;
+}
+
+QStringList QSQLiteExDriver::subscribedToNotifications() const
+{
+    Q_D(const QSQLiteExDriver);
+    return d->notificationid;
+}
+
+/*
+   Copies the open database into fileName with the online backup API,
+   pagesPerStep pages at a time. The source is only locked while a step
+   runs, so other connections can keep writing in between. The destination
+   is keyed with password and, unless cipher is -1, encrypted with that
+   CODEC_TYPE_* cipher instead of the compiled default, which allows
+   re-encrypting a database while backing it up.
+   Steps that find the source busy or locked are retried for at most 30
+   seconds without progress. The destination is only written when the
+   backup completes; a file created by a failed backup is removed.
+*/
+bool QSQLiteExDriver::backup(const QString &fileName, const QString &password,
+                             int cipher, int pagesPerStep, int stepDelay)
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen() || isOpenError())
+        return false;
+
+    const bool destExisted = QFile::exists(fileName);
+    sqlite3 *dest = 0;
+    int res = sqlite3_open_v2(fileName.toUtf8().constData(), &dest,
+                              SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, NULL);
+    if (res == SQLITE_OK && cipher >= 0 && sqlite3mc_config(dest, "cipher", cipher) < 0) {
+        sqlite3_close(dest);
+        if (!destExisted)
+            QFile::remove(fileName);
+        setLastError(QSqlError(tr("Unable to back up database"), QStringLiteral("invalid cipher"),
+                               QSqlError::ConnectionError));
+        return false;
+    }
+    if (res == SQLITE_OK) {
+        const QByteArray key = password.toUtf8();
+        res = sqlite3_key(dest, key.constData(), key.length());
+    }
+
+    sqlite3_backup *backup = 0;
+    if (res == SQLITE_OK) {
+        backup = sqlite3_backup_init(dest, "main", d->access, "main");
+        if (!backup)
+            res = sqlite3_errcode(dest);
+    }
+
+    if (backup) {
+        if (pagesPerStep <= 0)
+            pagesPerStep = -1;
+        QElapsedTimer busy;
+        do {
+            res = sqlite3_backup_step(backup, pagesPerStep);
+            emit backupProgress(sqlite3_backup_remaining(backup), sqlite3_backup_pagecount(backup));
+            if (res == SQLITE_OK) {
+                busy.invalidate();
+            } else if (res == SQLITE_BUSY || res == SQLITE_LOCKED) {
+                if (!busy.isValid())
+                    busy.start();
+                else if (busy.hasExpired(30000))
+                    break;
+            }
+            if (res == SQLITE_OK || res == SQLITE_BUSY || res == SQLITE_LOCKED) {
+                // give the writers a chance before the next step locks the source again
+                if (stepDelay > 0)
+                    sqlite3_sleep(stepDelay);
+                else
+                    QThread::yieldCurrentThread();
+            }
+        } while (res == SQLITE_OK || res == SQLITE_BUSY || res == SQLITE_LOCKED);
+        const int finishRes = sqlite3_backup_finish(backup);
+        if (res == SQLITE_DONE)
+            res = finishRes;
+    }
+
+    if (res != SQLITE_OK)
+        setLastError(qMakeError(dest, tr("Unable to back up database"), QSqlError::ConnectionError, res));
+    sqlite3_close(dest);
+    // sqlite3_backup_finish() rolled an existing destination back
+    if (res != SQLITE_OK && !destExisted)
+        QFile::remove(fileName);
+    return res == SQLITE_OK;
+}
+
+/*
+   Returns the page image of schema ("main" by default). In-memory
+   databases are returned without an intermediate SQLite copy.
+   Warning: pages are read through the codec, so the image is the
+   DECRYPTED database. Whoever gets the image, e.g. through a file or the
+   network, can read all of it without the key. For databases opened with
+   a key the image is therefore only returned if allowPlaintext is true.
+*/
+QByteArray QSQLiteExDriver::serialize(const QString &schema, bool allowPlaintext)
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen() || isOpenError())
+        return QByteArray();
+    if (!d->key.isEmpty() && !allowPlaintext) {
+        setLastError(QSqlError(tr("Unable to serialize database"),
+                               QStringLiteral("the image of an encrypted database is plaintext, "
+                                              "pass allowPlaintext to get it"),
+                               QSqlError::ConnectionError));
+        return QByteArray();
+    }
+
+    const QByteArray schemaName = schema.isEmpty() ? QByteArray("main") : schema.toUtf8();
+    sqlite3_int64 size = 0;
+    const unsigned char *data = sqlite3_serialize(d->access, schemaName.constData(), &size,
+                                                  SQLITE_SERIALIZE_NOCOPY);
+    unsigned char *copy = 0;
+    if (!data) {
+        copy = sqlite3_serialize(d->access, schemaName.constData(), &size, 0);
+        data = copy;
+    }
+    // QByteArray sizes are ints
+    if (!data || size > std::numeric_limits<int>::max()) {
+        sqlite3_free(copy);
+        setLastError(qMakeError(d->access, tr("Unable to serialize database"),
+                                QSqlError::ConnectionError, SQLITE_NOMEM));
+        return QByteArray();
+    }
+    const QByteArray image(reinterpret_cast<const char *>(data), int(size));
+    sqlite3_free(copy);
+    return image;
+}
+
+/*
+   Replaces schema ("main" by default) with an in-memory database holding
+   image, e.g. after opening ":memory:". A read-only image is used in place
+   and kept referenced until the driver is closed; a writable one is copied
+   once into SQLite owned memory so it can grow.
+   The cipher VFS does not see in-memory databases, so only plaintext images
+   as produced by serialize() can be loaded.
+*/
+bool QSQLiteExDriver::deserialize(const QByteArray &image, bool readOnly, const QString &schema)
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen() || isOpenError())
+        return false;
+
+    if (!image.startsWith(QByteArray("SQLite format 3", 16))) {
+        setLastError(QSqlError(tr("Unable to deserialize database"),
+                               tr("Image is encrypted or not a database"), QSqlError::ConnectionError));
+        return false;
+    }
+
+    const QByteArray schemaName = schema.isEmpty() ? QByteArray("main") : schema.toUtf8();
+    int res;
+    if (readOnly) {
+        res = sqlite3_deserialize(d->access, schemaName.constData(),
+                                  reinterpret_cast<unsigned char *>(const_cast<char *>(image.constData())),
+                                  image.size(), image.size(), SQLITE_DESERIALIZE_READONLY);
+        if (res == SQLITE_OK)
+            d->images.insert(QString::fromUtf8(schemaName), image);
+    } else {
+        unsigned char *data = static_cast<unsigned char *>(sqlite3_malloc64(image.size()));
+        if (!data) {
+            res = SQLITE_NOMEM;
+        } else {
+            memcpy(data, image.constData(), image.size());
+            res = sqlite3_deserialize(d->access, schemaName.constData(), data, image.size(), image.size(),
+                                      SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_RESIZEABLE);
+            if (res == SQLITE_OK)
+                d->images.remove(QString::fromUtf8(schemaName));
+        }
+    }
+
+    if (res != SQLITE_OK) {
+        setLastError(qMakeError(d->access, tr("Unable to deserialize database"),
+                                QSqlError::ConnectionError, res));
+        return false;
+    }
+    return true;
+}
+
+/*
+   Fills the FTS5 table with the rows returned by nextRow until it returns
+   false, committing every batchSize rows unless a transaction is already
+   open. Automatic merging is switched off while loading, then the index is
+   optimized once at the end instead of being merged over and over during
+   the load. FTS5 keeps automerge and crisismerge in the table's %_config
+   shadow table, so they persist: -1 keeps the table's current values (the
+   automerge value is read before and written back after the load), other
+   values replace them.
+*/
+bool QSQLiteExDriver::ftsBulkInsert(const QString &table, const QStringList &columns,
+                                    const std::function<bool(QVector<QVariant> &row)> &nextRow,
+                                    int batchSize, int automerge, int crisismerge, bool optimize)
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen() || isOpenError() || columns.isEmpty())
+        return false;
+
+    const QString escapedTable = _q_escapeIdentifier(table);
+    const QString ftsColumn = _q_escapeIdentifier(table.mid(table.lastIndexOf(QLatin1Char('.')) + 1));
+    const QString command = QLatin1String("INSERT INTO ") + escapedTable + QLatin1Char('(') + ftsColumn
+            + QLatin1String(", rank) VALUES('%1', %2)");
+
+    QString sql = QLatin1String("INSERT INTO ") + escapedTable + QLatin1Char('(');
+    for (int i = 0; i < columns.count(); ++i)
+        sql += (i ? QLatin1String(", ") : QLatin1String("")) + _q_escapeIdentifier(columns.at(i));
+    sql += QLatin1String(") VALUES(?");
+    for (int i = 1; i < columns.count(); ++i)
+        sql += QLatin1String(", ?");
+    sql += QLatin1Char(')');
+
+    // FTS5 uses automerge 4 while the %_config table has no value
+    if (automerge < 0) {
+        const QString config = QLatin1String("SELECT v FROM ") + _q_escapeIdentifier(table + QLatin1String("_config"))
+                + QLatin1String(" WHERE k = 'automerge'");
+        const qint64 current = qPragmaInt(d->access, config.toUtf8().constData());
+        automerge = current < 0 ? 4 : int(current);
+    }
+
+    int res = qExecSql(d->access, command.arg(QLatin1String("automerge")).arg(0));
+    if (res == SQLITE_OK && crisismerge >= 0)
+        res = qExecSql(d->access, command.arg(QLatin1String("crisismerge")).arg(crisismerge));
+
+    sqlite3_stmt *stmt = 0;
+    if (res == SQLITE_OK)
+        res = sqlite3_prepare16_v3(d->access, sql.constData(), (sql.size() + 1) * sizeof(QChar),
+                                   SQLITE_PREPARE_PERSISTENT, &stmt, NULL);
+
+    const bool ownTransaction = sqlite3_get_autocommit(d->access);
+    if (res == SQLITE_OK && ownTransaction)
+        res = qExecSql(d->access, QLatin1String("BEGIN"));
+
+    QVector<QVariant> row;
+    int pending = 0;
+    while (res == SQLITE_OK) {
+        row.clear();
+        if (!nextRow(row))
+            break;
+        for (int i = 0; i < columns.count() && res == SQLITE_OK; ++i)
+            res = i < row.count() ? qBindValue(stmt, i + 1, row.at(i), d->dateTimeEncoding)
+                                  : sqlite3_bind_null(stmt, i + 1);
+        if (res == SQLITE_OK) {
+            res = sqlite3_step(stmt);
+            // sqlite3_reset() reports the specific error of a failed step
+            const int resetRes = sqlite3_reset(stmt);
+            if (res == SQLITE_DONE)
+                res = resetRes;
+        }
+        if (res == SQLITE_OK && ownTransaction && ++pending >= batchSize) {
+            pending = 0;
+            res = qExecSql(d->access, QLatin1String("COMMIT"));
+            if (res == SQLITE_OK)
+                res = qExecSql(d->access, QLatin1String("BEGIN"));
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    if (res == SQLITE_OK && ownTransaction)
+        res = qExecSql(d->access, QLatin1String("COMMIT"));
+    if (res != SQLITE_OK) {
+        setLastError(qMakeError(d->access, tr("Unable to fill full-text index"),
+                                QSqlError::StatementError, res));
+        if (ownTransaction && !sqlite3_get_autocommit(d->access))
+            qExecSql(d->access, QLatin1String("ROLLBACK"));
+    }
+
+    // restore merging even if the load failed
+    int configRes = qExecSql(d->access, command.arg(QLatin1String("automerge")).arg(automerge));
+    if (res == SQLITE_OK && configRes == SQLITE_OK && optimize)
+        configRes = qExecSql(d->access, QLatin1String("INSERT INTO ") + escapedTable + QLatin1Char('(')
+                             + ftsColumn + QLatin1String(") VALUES('optimize')"));
+    if (res == SQLITE_OK && configRes != SQLITE_OK) {
+        setLastError(qMakeError(d->access, tr("Unable to optimize full-text index"),
+                                QSqlError::StatementError, configRes));
+        return false;
+    }
+    return res == SQLITE_OK;
+}
+
+/*
+   Runs a ranked full-text query. The returned forward-only query streams
+   rowid, the bm25 rank and, if snippetColumn is not -1, a snippet of that
+   column, best matches first.
+*/
+QSqlQuery QSQLiteExDriver::ftsSearch(const QString &table, const QString &match, int snippetColumn,
+                                     int limit, int snippetTokens) const
+{
+    const QString ftsColumn = _q_escapeIdentifier(table.mid(table.lastIndexOf(QLatin1Char('.')) + 1));
+    QString sql = QLatin1String("SELECT rowid, rank");
+    if (snippetColumn >= 0) {
+        sql += QString::fromLatin1(", snippet(%1, %2, '<b>', '</b>', '...', %3)")
+                .arg(ftsColumn).arg(snippetColumn).arg(snippetTokens);
+    }
+    sql += QLatin1String(" FROM ") + _q_escapeIdentifier(table) + QLatin1String(" WHERE ") + ftsColumn
+            + QLatin1String(" MATCH ? ORDER BY rank");
+    if (limit >= 0)
+        sql += QLatin1String(" LIMIT ") + QString::number(limit);
+
+    QSqlQuery q(createResult());
+    q.setForwardOnly(true);
+    if (q.prepare(sql)) {
+        q.addBindValue(match);
+        q.exec();
+    }
+    return q;
+}
+
+/*
+   Registers tokenizer as FTS5 tokenizer name on this connection. The
+   text is handed over as QString and the token positions are mapped back
+   to the UTF-8 offsets FTS5 expects, so e.g. QTextBoundaryFinder can be
+   used to split CJK text.
+*/
+bool QSQLiteExDriver::registerFtsTokenizer(const QString &name, const QSQLiteExFtsTokenizer &tokenizer)
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen() || isOpenError() || !tokenizer)
+        return false;
+
+    QSQLiteExFtsModule *module = new QSQLiteExFtsModule;
+    module->tokenizer = tokenizer;
+    const int res = qCreateFtsTokenizer(d->access, name, module);
+    if (res != SQLITE_OK) {
+        setLastError(qMakeError(d->access, tr("Unable to register tokenizer"), QSqlError::ConnectionError, res));
+        return false;
+    }
+    return true;
+}
+
+/*
+   Registers filter as FTS5 tokenizer name that post-processes the tokens of
+   another tokenizer, which is given as the first tokenizer argument like
+   with the porter tokenizer: tokenize = 'name unicode61 remove_diacritics 2'.
+   Filters can be chained.
+*/
+bool QSQLiteExDriver::registerFtsTokenFilter(const QString &name, const QSQLiteExFtsTokenFilter &filter)
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen() || isOpenError() || !filter)
+        return false;
+
+    QSQLiteExFtsModule *module = new QSQLiteExFtsModule;
+    module->filter = filter;
+    const int res = qCreateFtsTokenizer(d->access, name, module);
+    if (res != SQLITE_OK) {
+        setLastError(qMakeError(d->access, tr("Unable to register tokenizer"), QSqlError::ConnectionError, res));
+        return false;
+    }
+    return true;
+}
+
+/*
+   Imports a CSV (RFC 4180) or JSON Lines file into table. The file is
+   mapped, split into chunks at record boundaries and parsed on
+   parseThreads worker threads, while this thread binds the cells straight
+   from the file to a persistent prepared insert and commits every
+   commitInterval rows unless a transaction is already open. columns
+   defaults to the CSV header or the keys of the first JSON object.
+   Returns rows, bytes, msecs, rowsPerSecond and megabytesPerSecond, or an
+   empty map on error.
+*/
+QVariantMap QSQLiteExDriver::importFile(const QString &fileName, const QString &table,
+                                        const QStringList &columns, int format, bool header,
+                                        int commitInterval, int parseThreads)
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen() || isOpenError() || (format != Csv && format != JsonLines))
+        return QVariantMap();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        setLastError(QSqlError(tr("Unable to open import file"), file.errorString(),
+                               QSqlError::UnknownError));
+        return QVariantMap();
+    }
+    QByteArray contents;
+    const char *begin = reinterpret_cast<const char *>(file.size() ? file.map(0, file.size()) : 0);
+    if (!begin) {
+        contents = file.readAll();
+        begin = contents.constData();
+    }
+    const char *end = begin + (contents.isNull() ? file.size() : contents.size());
+    const qint64 bytes = end - begin;
+
+    QStringList names = columns;
+    if (format == Csv && header) {
+        const char *stop = qCsvChunkEnd(begin, end, 0);
+        if (names.isEmpty()) {
+            QSQLiteExImportChunk chunk;
+            qParseCsv(begin, stop, stop == end, &chunk);
+            for (const QSQLiteExImportCell &cell : qAsConst(chunk.cells))
+                names.append(QString::fromUtf8(cell.text, cell.size));
+        }
+        begin = stop;
+    } else if (format == JsonLines && names.isEmpty()) {
+        const char *stop = qLineChunkEnd(begin, end, 0);
+        names = QJsonDocument::fromJson(QByteArray::fromRawData(begin, int(stop - begin))).object().keys();
+    }
+    if (format == JsonLines && names.isEmpty()) {
+        setLastError(QSqlError(tr("Unable to import file"), QStringLiteral("no columns"),
+                               QSqlError::StatementError));
+        return QVariantMap();
+    }
+
+    // without column names, CSV cells fill the table's columns in order
+    int paramCount = names.size();
+    QString sql = QLatin1String("INSERT INTO ") + _q_escapeIdentifier(table);
+    if (!names.isEmpty()) {
+        sql += QLatin1Char('(');
+        for (int i = 0; i < names.count(); ++i)
+            sql += (i ? QLatin1String(", ") : QLatin1String("")) + _q_escapeIdentifier(names.at(i));
+        sql += QLatin1Char(')');
+    } else {
+        QSQLiteExImportChunk chunk;
+        const char *stop = qCsvChunkEnd(begin, end, 0);
+        qParseCsv(begin, stop, stop == end, &chunk);
+        paramCount = chunk.cells.size();
+    }
+    sql += QLatin1String(" VALUES(?");
+    for (int i = 1; i < paramCount; ++i)
+        sql += QLatin1String(", ?");
+    sql += QLatin1Char(')');
+
+    sqlite3_stmt *stmt = 0;
+    int res = sqlite3_prepare16_v3(d->access, sql.constData(), (sql.size() + 1) * sizeof(QChar),
+                                   SQLITE_PREPARE_PERSISTENT, &stmt, NULL);
+
+    const bool ownTransaction = sqlite3_get_autocommit(d->access);
+    if (res == SQLITE_OK && ownTransaction)
+        res = qExecSql(d->access, QLatin1String("BEGIN"));
+
+    if (parseThreads <= 0)
+        parseThreads = qMax(1, QThread::idealThreadCount() - 1);
+    QSQLiteExImportPipeline pipeline(begin, end, format, names, parseThreads * 2);
+    QVector<QSQLiteExImportWorker *> workers;
+    for (int i = 0; i < parseThreads && res == SQLITE_OK; ++i) {
+        workers.append(new QSQLiteExImportWorker(&pipeline));
+        workers.last()->start();
+    }
+
+    qint64 rows = 0;
+    int pending = 0;
+    QString parseError;
+    while (res == SQLITE_OK) {
+        QSQLiteExImportChunk *chunk = pipeline.take();
+        if (!chunk)
+            break;
+        int first = 0;
+        for (int r = 0; r < chunk->rowEnds.size() && res == SQLITE_OK; ++r) {
+            const int last = chunk->rowEnds.at(r);
+            for (int i = 0; i < paramCount && res == SQLITE_OK; ++i) {
+                if (first + i >= last) {
+                    res = sqlite3_bind_null(stmt, i + 1);
+                    continue;
+                }
+                // the chunk outlives the step, so nothing is copied
+                const QSQLiteExImportCell &cell = chunk->cells.at(first + i);
+                switch (cell.kind) {
+                case QSQLiteExImportCell::Text:
+                    res = sqlite3_bind_text(stmt, i + 1, cell.text, cell.size, SQLITE_STATIC);
+                    break;
+                case QSQLiteExImportCell::Integer:
+                    res = sqlite3_bind_int64(stmt, i + 1, cell.integer);
+                    break;
+                case QSQLiteExImportCell::Real:
+                    res = sqlite3_bind_double(stmt, i + 1, cell.real);
+                    break;
+                default:
+                    res = sqlite3_bind_null(stmt, i + 1);
+                    break;
+                }
+            }
+            first = last;
+            if (res == SQLITE_OK) {
+                res = sqlite3_step(stmt);
+                const int resetRes = sqlite3_reset(stmt);
+                if (res == SQLITE_DONE)
+                    res = resetRes;
+            }
+            if (res == SQLITE_OK)
+                ++rows;
+            if (res == SQLITE_OK && ownTransaction && ++pending >= commitInterval) {
+                pending = 0;
+                res = qExecSql(d->access, QLatin1String("COMMIT"));
+                if (res == SQLITE_OK)
+                    res = qExecSql(d->access, QLatin1String("BEGIN"));
+            }
+        }
+        parseError = chunk->error;
+        delete chunk;
+        if (!parseError.isEmpty())
+            break;
+    }
+
+    pipeline.abort();
+    for (QSQLiteExImportWorker *worker : qAsConst(workers)) {
+        worker->wait();
+        delete worker;
+    }
+    sqlite3_finalize(stmt);
+
+    if (res == SQLITE_OK && parseError.isEmpty() && ownTransaction)
+        res = qExecSql(d->access, QLatin1String("COMMIT"));
+    if (res != SQLITE_OK || !parseError.isEmpty()) {
+        if (res != SQLITE_OK)
+            setLastError(qMakeError(d->access, tr("Unable to import file"), QSqlError::StatementError, res));
+        else
+            setLastError(QSqlError(tr("Unable to import file"), parseError, QSqlError::StatementError));
+        if (ownTransaction && !sqlite3_get_autocommit(d->access))
+            qExecSql(d->access, QLatin1String("ROLLBACK"));
+        return QVariantMap();
+    }
+    return qTransferStats(rows, bytes, timer.elapsed());
+}
+
+/*
+   Writes the rows of query to fileName as CSV or JSON Lines. Values are
+   taken straight from sqlite3_column_text()/blob(), numbers in SQLite's own
+   text form (infinite reals as null in JSON) and JSON blobs as base64, and
+   written in 1 MB blocks. Returns the same statistics as importFile().
+*/
+QVariantMap QSQLiteExDriver::exportQuery(const QString &query, const QString &fileName, int format, bool header)
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen() || isOpenError() || (format != Csv && format != JsonLines))
+        return QVariantMap();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    sqlite3_stmt *stmt = 0;
+    int res = sqlite3_prepare16_v2(d->access, query.constData(), (query.size() + 1) * sizeof(QChar),
+                                   &stmt, NULL);
+    if (res != SQLITE_OK) {
+        setLastError(qMakeError(d->access, tr("Unable to export query"), QSqlError::StatementError, res));
+        sqlite3_finalize(stmt);
+        return QVariantMap();
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        setLastError(QSqlError(tr("Unable to open export file"), file.errorString(),
+                               QSqlError::UnknownError));
+        sqlite3_finalize(stmt);
+        return QVariantMap();
+    }
+
+    const int columnCount = sqlite3_column_count(stmt);
+    QVector<QByteArray> names(columnCount);
+    for (int i = 0; i < columnCount; ++i) {
+        const char *name = sqlite3_column_name(stmt, i);
+        names[i] = QByteArray(name ? name : "");
+    }
+
+    QByteArray out;
+    out.reserve(1024 * 1024 + 64 * 1024);
+    if (format == Csv && header) {
+        for (int i = 0; i < columnCount; ++i) {
+            if (i)
+                out.append(',');
+            qAppendCsv(out, names.at(i).constData(), names.at(i).size());
+        }
+        out.append('\n');
+    }
+
+    qint64 rows = 0;
+    qint64 bytes = 0;
+    bool writeError = false;
+    while ((res = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (format == JsonLines)
+            out.append('{');
+        for (int i = 0; i < columnCount; ++i) {
+            if (format == Csv) {
+                if (i)
+                    out.append(',');
+                const int type = sqlite3_column_type(stmt, i);
+                if (type == SQLITE_NULL)
+                    continue;
+                const char *text = reinterpret_cast<const char *>(type == SQLITE_BLOB ? sqlite3_column_blob(stmt, i)
+                                                                                      : sqlite3_column_text(stmt, i));
+                qAppendCsv(out, text, sqlite3_column_bytes(stmt, i));
+                continue;
+            }
+            if (i)
+                out.append(',');
+            qAppendJsonString(out, names.at(i).constData(), names.at(i).size());
+            out.append(':');
+            switch (sqlite3_column_type(stmt, i)) {
+            case SQLITE_INTEGER:
+            case SQLITE_FLOAT:
+                // SQLite writes Inf and -Inf, which JSON has no number for
+                if (sqlite3_column_type(stmt, i) == SQLITE_FLOAT && !qIsFinite(sqlite3_column_double(stmt, i))) {
+                    out.append("null");
+                    break;
+                }
+                out.append(reinterpret_cast<const char *>(sqlite3_column_text(stmt, i)),
+                           sqlite3_column_bytes(stmt, i));
+                break;
+            case SQLITE_TEXT:
+                qAppendJsonString(out, reinterpret_cast<const char *>(sqlite3_column_text(stmt, i)),
+                                  sqlite3_column_bytes(stmt, i));
+                break;
+            case SQLITE_BLOB:
+                out.append('"');
+                qAppendBase64(out, static_cast<const char *>(sqlite3_column_blob(stmt, i)),
+                              sqlite3_column_bytes(stmt, i));
+                out.append('"');
+                break;
+            default:
+                out.append("null");
+                break;
+            }
+        }
+        out.append(format == JsonLines ? "}\n" : "\n");
+        ++rows;
+        if (out.size() >= 1024 * 1024) {
+            writeError = file.write(out) != out.size();
+            bytes += out.size();
+            out.resize(0); // keeps the reserved buffer, clear() would free it
+            if (writeError)
+                break;
+        }
+    }
+    if (!writeError && !out.isEmpty()) {
+        writeError = file.write(out) != out.size();
+        bytes += out.size();
+    }
+    sqlite3_finalize(stmt);
+
+    if (writeError) {
+        setLastError(QSqlError(tr("Unable to write export file"), file.errorString(), QSqlError::UnknownError));
+        return QVariantMap();
+    }
+    if (res != SQLITE_DONE) {
+        setLastError(qMakeError(d->access, tr("Unable to export query"), QSqlError::StatementError, res));
+        return QVariantMap();
+    }
+    return qTransferStats(rows, bytes, timer.elapsed());
+}
+
+// by the affinity of the declared type, else by the storage class in the current row
+static QSQLiteExColumnBatch::Type qBatchColumnType(sqlite3_stmt *stmt, int column)
+{
+    const QByteArray declType = QByteArray(sqlite3_column_decltype(stmt, column)).toUpper();
+    if (declType.contains("INT"))
+        return QSQLiteExColumnBatch::Integer;
+    if (declType.contains("CHAR") || declType.contains("CLOB") || declType.contains("TEXT"))
+        return QSQLiteExColumnBatch::Text;
+    if (declType.contains("BLOB"))
+        return QSQLiteExColumnBatch::Blob;
+    if (declType.contains("REAL") || declType.contains("FLOA") || declType.contains("DOUB"))
+        return QSQLiteExColumnBatch::Real;
+
+    switch (sqlite3_column_type(stmt, column)) {
+    case SQLITE_INTEGER:
+        return QSQLiteExColumnBatch::Integer;
+    case SQLITE_FLOAT:
+        return QSQLiteExColumnBatch::Real;
+    case SQLITE_BLOB:
+        return QSQLiteExColumnBatch::Blob;
+    default:
+        return QSQLiteExColumnBatch::Text;
+    }
+}
+
+// sizes the buffers for maxRows, stmt is on the first row of the batch; names
+// and types are derived again for another statement unless overridden
+static void qPrepareColumnBatch(sqlite3_stmt *stmt, QSQLiteExColumnBatch &batch, int maxRows)
 {
-    Q_D(QSQLiteExDriver);
-    d->access = connection;
-    setOpen(true);
-    setOpenError(false);
+    const int nCols = sqlite3_column_count(stmt);
+    const char *sql = sqlite3_sql(stmt);
+    const bool overridden = batch.overrideTypes && batch.columns.count() == nCols;
+    if (!overridden && (batch.columns.count() != nCols || batch.statement != sql)) {
+        batch.columns.resize(nCols);
+        for (int i = 0; i < nCols; ++i) {
+            batch.columns[i].name.clear();
+            batch.columns[i].type = qBatchColumnType(stmt, i);
+        }
+    }
+    batch.statement = sql;
+    for (int i = 0; i < nCols; ++i) {
+        QSQLiteExColumnBatch::Column &column = batch.columns[i];
+        if (column.name.isEmpty())
+            column.name = QString(reinterpret_cast<const QChar *>(sqlite3_column_name16(stmt, i)));
+        column.nulls.assign((maxRows + 63) / 64, 0);
+        switch (column.type) {
+        case QSQLiteExColumnBatch::Integer:
+            column.integers.resize(maxRows);
+            break;
+        case QSQLiteExColumnBatch::Real:
+            column.reals.resize(maxRows);
+            break;
+        default:
+            column.offsets.resize(maxRows + 1);
+            column.offsets[0] = 0;
+            column.data.clear();
+            break;
+        }
+    }
 }
 
+static void qReadColumnRow(sqlite3_stmt *stmt, QSQLiteExColumnBatch &batch, int row)
+{
+    QSQLiteExColumnBatch::Column *columns = batch.columns.data();
+    for (int i = 0; i < batch.columns.count(); ++i) {
+        QSQLiteExColumnBatch::Column &column = columns[i];
+        if (sqlite3_column_type(stmt, i) == SQLITE_NULL)
+            column.nulls[row >> 6] |= Q_UINT64_C(1) << (row & 63);
+        // NULL reads as 0 or empty
+        switch (column.type) {
+        case QSQLiteExColumnBatch::Integer:
+            column.integers[row] = sqlite3_column_int64(stmt, i);
+            break;
+        case QSQLiteExColumnBatch::Real:
+            column.reals[row] = sqlite3_column_double(stmt, i);
+            break;
+        default: {
+            // the pointer has to be fetched before the size, see sqlite3_column_bytes()
+            const char *data = column.type == QSQLiteExColumnBatch::Text
+                    ? reinterpret_cast<const char *>(sqlite3_column_text(stmt, i))
+                    : static_cast<const char *>(sqlite3_column_blob(stmt, i));
+            const int size = sqlite3_column_bytes(stmt, i);
+            if (size > 0)
+                column.data.insert(column.data.end(), data, data + size);
+            column.offsets[row + 1] = qint64(column.data.size());
+            break;
+        }
+        }
+    }
+}
 
-QSQLiteExDriver::~QSQLiteExDriver()
+// drops the unused tail, keeping the capacity for the next batch
+static void qFinishColumnBatch(QSQLiteExColumnBatch &batch, int rows)
 {
-    close();
+    for (int i = 0; i < batch.columns.count(); ++i) {
+        QSQLiteExColumnBatch::Column &column = batch.columns[i];
+        column.nulls.resize((rows + 63) / 64);
+        switch (column.type) {
+        case QSQLiteExColumnBatch::Integer:
+            column.integers.resize(rows);
+            break;
+        case QSQLiteExColumnBatch::Real:
+            column.reals.resize(rows);
+            break;
+        default:
+            column.offsets.resize(rows + 1);
+            if (rows == 0)
+                column.data.clear();
+            break;
+        }
+    }
+    batch.rowCount = rows;
 }
 
-bool QSQLiteExDriver::hasFeature(DriverFeature f) const
+/*
+   Fetches the next maxRows rows of the active forward-only select query
+   into the column buffers of batch, straight from sqlite3_column_*()
+   without QVariant. Column types follow the declared types unless batch
+   sets overrideTypes and one column per result column. Returns the number
+   of rows, 0 at the end of the result set or -1 on error (see
+   query.lastError()). Use it instead of query.next(), the rows it returns
+   are not seen by QSqlQuery.
+*/
+int QSQLiteExDriver::fetchColumns(QSqlQuery &query, QSQLiteExColumnBatch &batch, int maxRows) const
 {
-    switch (f) {
-    case BLOB:
-    case Transactions:
-    case Unicode:
-    case LastInsertId:
-    case PreparedQueries:
-    case PositionalPlaceholders:
-    case SimpleLocking:
-    case FinishQuery:
-    case LowPrecisionNumbers:
-    case EventNotifications:
-        return true;
-    case QuerySize:
-    case BatchOperations:
-    case MultipleResultSets:
-    case CancelQuery:
-        return false;
-    case NamedPlaceholders:
-#if (SQLITE_VERSION_NUMBER < 3003011)
-        return false;
-#else
-        return true;
-#endif
+    batch.rowCount = 0;
+    QSQLiteExResult *result = static_cast<QSQLiteExResult *>(const_cast<QSqlResult *>(query.result()));
+    if (!result || query.driver() != this || maxRows <= 0)
+        return -1;
+    QSQLiteExResultPrivate *rd = result->d_func();
+    if (!rd->beginBatch())
+        return -1;
+
+    int rows = 0;
+    int res = SQLITE_ROW;
+    while (rows < maxRows && (res = rd->stepBatch()) == SQLITE_ROW) {
+        if (rows == 0)
+            qPrepareColumnBatch(rd->stmt, batch, maxRows);
+        qReadColumnRow(rd->stmt, batch, rows);
+        ++rows;
+    }
+    if (res != SQLITE_ROW && res != SQLITE_DONE) {
+        qFinishColumnBatch(batch, 0);
+        return -1;
+    }
+    qFinishColumnBatch(batch, rows);
+    return rows;
+}
 
+static void qReadCell(sqlite3_stmt *stmt, int column, QSQLiteExArena &arena, QSQLiteExCell &cell)
+{
+    const int type = sqlite3_column_type(stmt, column);
+    cell.size = 0;
+    switch (type) {
+    case SQLITE_INTEGER:
+        cell.type = QSQLiteExCell::Integer;
+        cell.integer = sqlite3_column_int64(stmt, column);
+        break;
+    case SQLITE_FLOAT:
+        cell.type = QSQLiteExCell::Real;
+        cell.real = sqlite3_column_double(stmt, column);
+        break;
+    case SQLITE_TEXT:
+    case SQLITE_BLOB: {
+        // the pointer has to be fetched before the size, see sqlite3_column_bytes()
+        const char *data = type == SQLITE_TEXT ? reinterpret_cast<const char *>(sqlite3_column_text(stmt, column))
+                                               : static_cast<const char *>(sqlite3_column_blob(stmt, column));
+        const int size = sqlite3_column_bytes(stmt, column);
+        char *copy = arena.allocate(size);
+        if (size > 0)
+            memcpy(copy, data, size);
+        cell.type = type == SQLITE_TEXT ? QSQLiteExCell::Text : QSQLiteExCell::Blob;
+        cell.data = copy;
+        cell.size = size;
+        break;
+    }
+    default:
+        cell.type = QSQLiteExCell::Null;
+        cell.integer = 0;
+        break;
     }
-    return false;
 }
 
 /*
-   SQLite dbs have no user name, passwords, hosts or ports.
-   just file names.
-   changes: using user and password to encryption the db
+   Fetches the next maxRows rows of the active forward-only select query
+   into batch, row by row. Text and blob cells are copied into an arena
+   owned by the query's result and point into it; the arena is rewound by
+   the next fetchRows() on the query, so a scan reuses the same memory
+   batch after batch instead of allocating a QString or QByteArray per
+   cell. Returns the number of rows, 0 at the end of the result set or -1
+   on error (see query.lastError()). Use it instead of query.next().
 */
-bool QSQLiteExDriver::open(const QString &db, const QString &user, const QString &password, const QString &host, int port, const QString &conOpts)
+int QSQLiteExDriver::fetchRows(QSqlQuery &query, QSQLiteExRowBatch &batch, int maxRows) const
 {
-    Q_UNUSED(user)
-    Q_UNUSED(password)
-    Q_UNUSED(host)
-    Q_UNUSED(port)
+    batch.rowCount = 0;
+    QSQLiteExResult *result = static_cast<QSQLiteExResult *>(const_cast<QSqlResult *>(query.result()));
+    if (!result || query.driver() != this || maxRows <= 0)
+        return -1;
+    QSQLiteExResultPrivate *rd = result->d_func();
+    if (!rd->beginBatch())
+        return -1;
+
+    // the cells of the previous batch end here
+    rd->arena.reset();
+    const int nCols = sqlite3_column_count(rd->stmt);
+    batch.columnCount = nCols;
+    batch.cells.resize(size_t(maxRows) * nCols);
+
+    int rows = 0;
+    int res = SQLITE_ROW;
+    while (rows < maxRows && (res = rd->stepBatch()) == SQLITE_ROW) {
+        QSQLiteExCell *cells = batch.cells.data() + size_t(rows) * nCols;
+        for (int i = 0; i < nCols; ++i)
+            qReadCell(rd->stmt, i, rd->arena, cells[i]);
+        ++rows;
+    }
+    if (res != SQLITE_ROW && res != SQLITE_DONE)
+        rows = 0;
+    batch.cells.resize(size_t(rows) * nCols);
+    batch.rowCount = rows;
+    return res == SQLITE_ROW || res == SQLITE_DONE ? rows : -1;
+}
 
+/*
+   Starts index builds, statistics and incremental vacuuming on a separate
+   connection in a background thread and returns immediately;
+   maintenanceFinished() reports the time spent in each phase. The database
+   should be in WAL mode so this connection can keep reading meanwhile.
+   createIndexStatements run in order, then PRAGMA optimize (or ANALYZE with
+   fullAnalyze) with analysis_limit, then incremental_vacuum(vacuumPages)
+   unless vacuumPages is 0 (-1 frees all pages).
+*/
+bool QSQLiteExDriver::startMaintenance(const QStringList &createIndexStatements, int analysisLimit,
+                                       bool fullAnalyze, int vacuumPages, int sorterThreads)
+{
     Q_D(QSQLiteExDriver);
-    if (isOpen())
-        close();
+    if (!isOpen() || isOpenError() || d->maintenance)
+        return false;
+    if (d->databaseName.isEmpty() || d->databaseName == QLatin1String(":memory:")
+            || d->databaseName.contains(QLatin1String("mode=memory"))) {
+        setLastError(QSqlError(tr("Unable to start maintenance"),
+                               QStringLiteral("in-memory databases cannot be shared"),
+                               QSqlError::ConnectionError));
+        return false;
+    }
 
+    QSQLiteExMaintenance *maintenance = new QSQLiteExMaintenance;
+    maintenance->databaseName = d->databaseName;
+    maintenance->key = d->key;
+    maintenance->openFlags = d->openFlags;
+    maintenance->indexes = createIndexStatements;
+    maintenance->sorterThreads = sorterThreads > 0 ? sorterThreads : QThread::idealThreadCount();
+    maintenance->analysisLimit = analysisLimit;
+    maintenance->fullAnalyze = fullAnalyze;
+    maintenance->vacuumPages = vacuumPages;
+    d->maintenance = maintenance;
+
+    // close() may have deleted it by the time the queued signal arrives
+    QPointer<QSQLiteExMaintenance> guard(maintenance);
+    connect(maintenance, &QThread::finished, this, [this, guard]() {
+        Q_D(QSQLiteExDriver);
+        if (!guard || d->maintenance != guard)
+            return;
+        d->maintenance = 0;
+        const QVariantMap report = guard->report;
+        const bool ok = guard->error.isEmpty();
+        guard->deleteLater();
+        emit maintenanceFinished(ok, report);
+    });
+    maintenance->start(QThread::LowPriority);
+    return true;
+}
 
-    int timeOut = 5000;
-    bool sharedCache = false;
-    bool openReadOnlyOption = false;
-    bool openUriOption = false;
-#if QT_CONFIG(regularexpression)
-    static const QLatin1String regexpConnectOption = QLatin1String("QSQLITE_ENABLE_REGEXP");
-    bool defineRegexp = false;
-    int regexpCacheSize = 25;
-#endif
+void QSQLiteExDriver::cancelMaintenance()
+{
+    Q_D(QSQLiteExDriver);
+    if (d->maintenance)
+        d->maintenance->cancel();
+}
 
-    const auto opts = conOpts.splitRef(QLatin1Char(';'));
-    for (auto option : opts) {
-        option = option.trimmed();
-        if (option.startsWith(QLatin1String("QSQLITE_BUSY_TIMEOUT"))) {
-            option = option.mid(20).trimmed();
-            if (option.startsWith(QLatin1Char('='))) {
-                bool ok;
-                const int nt = option.mid(1).trimmed().toInt(&ok);
-                if (ok)
-                    timeOut = nt;
-            }
-        } else if (option == QLatin1String("QSQLITE_OPEN_READONLY")) {
-            openReadOnlyOption = true;
-        } else if (option == QLatin1String("QSQLITE_OPEN_URI")) {
-            openUriOption = true;
-        } else if (option == QLatin1String("QSQLITE_ENABLE_SHARED_CACHE")) {
-            sharedCache = true;
+/*
+   Frees up to pages pages (all with 0) from the freelist of a database in
+   auto_vacuum = INCREMENTAL mode and emits spaceReclaimed() if that gave
+   space back. With the QSQLITE_VACUUM_SLICE option this runs on a timer
+   whenever the connection is idle, so space is given back in short slices
+   instead of one long VACUUM; a slice is skipped if the database is busy.
+   Returns the number of bytes reclaimed or -1 on error.
+*/
+qint64 QSQLiteExDriver::incrementalVacuum(int pages)
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen() || isOpenError())
+        return -1;
+
+    qint64 reclaimed = 0;
+    qint64 freelistCount = 0;
+    const int res = qIncrementalVacuum(d->access, pages, &reclaimed, &freelistCount);
+    if (res != SQLITE_OK) {
+        setLastError(qMakeError(d->access, tr("Unable to vacuum database"), QSqlError::StatementError, res));
+        return -1;
+    }
+    if (reclaimed > 0)
+        emit spaceReclaimed(reclaimed, freelistCount);
+    return reclaimed;
+}
+
+/*
+   Returns the sqlite3_db_status() figures of this connection in bytes
+   (cacheUsed, schemaUsed, stmtUsed, lookasideUsed slots and the lookaside
+   hit/miss counters, cache hits/misses/writes/spills) together with the
+   process wide memoryUsed, memoryHighwater and softHeapLimit. With
+   resetHighwater the highwater marks and counters start over.
+*/
+QVariantMap QSQLiteExDriver::memoryStatus(bool resetHighwater) const
+{
+    Q_D(const QSQLiteExDriver);
+    QVariantMap status;
+    if (!isOpen() || isOpenError())
+        return status;
+
+    static const struct {
+        int op;
+        const char *name;
+        bool highwater;
+    } figures[] = {
+        { SQLITE_DBSTATUS_CACHE_USED, "cacheUsed", false },
+        { SQLITE_DBSTATUS_SCHEMA_USED, "schemaUsed", false },
+        { SQLITE_DBSTATUS_STMT_USED, "stmtUsed", false },
+        { SQLITE_DBSTATUS_LOOKASIDE_USED, "lookasideUsed", false },
+        { SQLITE_DBSTATUS_LOOKASIDE_USED, "lookasideHighwater", true },
+        { SQLITE_DBSTATUS_LOOKASIDE_HIT, "lookasideHit", true },
+        { SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, "lookasideMissSize", true },
+        { SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, "lookasideMissFull", true },
+        { SQLITE_DBSTATUS_CACHE_HIT, "cacheHit", false },
+        { SQLITE_DBSTATUS_CACHE_MISS, "cacheMiss", false },
+        { SQLITE_DBSTATUS_CACHE_WRITE, "cacheWrite", false },
+        { SQLITE_DBSTATUS_CACHE_SPILL, "cacheSpill", false }
+    };
+    for (const auto &figure : figures) {
+        int current = 0;
+        int highwater = 0;
+        if (sqlite3_db_status(d->access, figure.op, &current, &highwater, 0) == SQLITE_OK)
+            status.insert(QLatin1String(figure.name), figure.highwater ? highwater : current);
+    }
+    status.insert(QStringLiteral("memoryUsed"), sqlite3_memory_used());
+    status.insert(QStringLiteral("memoryHighwater"), sqlite3_memory_highwater(resetHighwater));
+    status.insert(QStringLiteral("softHeapLimit"), sqlite3_soft_heap_limit64(-1));
+
+    if (resetHighwater) {
+        for (const auto &figure : figures) {
+            int current, highwater;
+            sqlite3_db_status(d->access, figure.op, &current, &highwater, 1);
         }
-#if QT_CONFIG(regularexpression)
-        else if (option.startsWith(regexpConnectOption)) {
-            option = option.mid(regexpConnectOption.size()).trimmed();
-            if (option.isEmpty()) {
-                defineRegexp = true;
-            } else if (option.startsWith(QLatin1Char('='))) {
-                bool ok = false;
-                const int cacheSize = option.mid(1).trimmed().toInt(&ok);
-                if (ok) {
-                    defineRegexp = true;
-                    if (cacheSize > 0)
-                        regexpCacheSize = cacheSize;
-                }
-            }
+    }
+    return status;
+}
+
+/*
+   Exposes rowCount rows of columns as the read-only virtual table temp.name.
+   The arrays are not copied and must stay unchanged until the table is
+   dropped or the connection closed. Equality and range constraints on the
+   rowid (the array index) and on sorted columns are answered with a binary
+   search, so the table can be the inner side of a join with no temp table.
+*/
+bool QSQLiteExDriver::createArrayTable(const QString &name, const QVector<QSQLiteExArrayColumn> &columns,
+                                       qint64 rowCount)
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen() || isOpenError() || columns.isEmpty() || rowCount < 0)
+        return false;
+    for (const QSQLiteExArrayColumn &column : columns) {
+        if (rowCount && (!column.data || column.stride <= 0))
+            return false;
+    }
+
+    if (!d->arrayModule) {
+        const int res = sqlite3_create_module_v2(d->access, "qt_array", &qArrayModule, &d->arrayTables, NULL);
+        if (res != SQLITE_OK) {
+            setLastError(qMakeError(d->access, tr("Unable to register array module"),
+                                    QSqlError::ConnectionError, res));
+            return false;
         }
+        d->arrayModule = true;
+    }
+
+    if (d->arrayTables.contains(name) && !dropArrayTable(name))
+        return false;
+
+    QSQLiteExArrayTable &table = d->arrayTables[name];
+    table.columns = columns;
+    table.rowCount = rowCount;
+    const int res = qExecSql(d->access, QLatin1String("CREATE VIRTUAL TABLE temp.")
+                             + _q_escapeIdentifier(name) + QLatin1String(" USING qt_array"));
+    if (res != SQLITE_OK) {
+        d->arrayTables.remove(name);
+        setLastError(qMakeError(d->access, tr("Unable to create array table"), QSqlError::StatementError, res));
+        return false;
+    }
+    return true;
+}
+
+bool QSQLiteExDriver::dropArrayTable(const QString &name)
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen() || isOpenError() || !d->arrayTables.contains(name))
+        return false;
+
+    const int res = qExecSql(d->access, QLatin1String("DROP TABLE temp.")
+                             + _q_escapeIdentifier(name));
+    if (res != SQLITE_OK) {
+        setLastError(qMakeError(d->access, tr("Unable to drop array table"), QSqlError::StatementError, res));
+        return false;
+    }
+    d->arrayTables.remove(name);
+    return true;
+}
+
+/*
+   Backend of createFunction(), createAggregate() and createWindowFunction().
+   Functions prefer UTF-16 so QString and QStringView arguments are read
+   without conversion.
+*/
+bool QSQLiteExDriver::createSqlFunction(const QString &name, int argumentCount, int flags, void *userData,
+                                        SqlFunction func, SqlFunction step, SqlFinal finalize,
+                                        SqlFinal value, SqlFunction inverse, void (*destroy)(void *))
+{
+    Q_D(QSQLiteExDriver);
+    if (!isOpen() || isOpenError()) {
+        if (destroy)
+            destroy(userData);
+        return false;
+    }
+
+    int textRep = SQLITE_UTF16;
+    if (flags & Deterministic)
+        textRep |= SQLITE_DETERMINISTIC;
+    if (flags & Innocuous)
+        textRep |= SQLITE_INNOCUOUS;
+    if (flags & DirectOnly)
+        textRep |= SQLITE_DIRECTONLY;
+
+    // both destroy userData if registering fails
+    const QByteArray utf8Name = name.toUtf8();
+    int res;
+    if (inverse)
+        res = sqlite3_create_window_function(d->access, utf8Name.constData(), argumentCount, textRep,
+                                             userData, step, finalize, value, inverse, destroy);
+    else
+        res = sqlite3_create_function_v2(d->access, utf8Name.constData(), argumentCount, textRep,
+                                         userData, func, step, finalize, destroy);
+    if (res != SQLITE_OK) {
+        setLastError(qMakeError(d->access, tr("Unable to register function"), QSqlError::ConnectionError, res));
+        return false;
+    }
+    return true;
+}
+
+void QSQLiteExDriver::handleNotification(const QString &tableName, qint64 rowid)
+{
+    Q_D(const QSQLiteExDriver);
+    if (d->notificationid.contains(tableName)) {
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+        emit notification(tableName);
 #endif
+        emit notification(tableName, QSqlDriver::UnknownSource, QVariant(rowid));
     }
+}
 
-    int openMode = (openReadOnlyOption ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE));
-    openMode |= (sharedCache ? SQLITE_OPEN_SHAREDCACHE : SQLITE_OPEN_PRIVATECACHE);
-    if (openUriOption)
-        openMode |= SQLITE_OPEN_URI;
+// collects the columns each table contributes to a statement while it is prepared
+static int qReadAuthorizer(void *data, int action, const char *table, const char *column,
+                           const char *, const char *)
+{
+    if (action == SQLITE_READ && table && column && *column) {
+        QStringList &columns = (*static_cast<QHash<QString, QStringList> *>(data))[QString::fromUtf8(table)];
+        const QString name = QString::fromUtf8(column);
+        if (!columns.contains(name))
+            columns.append(name);
+    }
+    return SQLITE_OK;
+}
 
-    openMode |= SQLITE_OPEN_NOMUTEX;
+// one line of EXPLAIN QUERY PLAN, e.g. "SEARCH t USING INDEX i (a=?)"
+static QVariantMap qPlanNode(int id, const QString &detail)
+{
+    QVariantMap node;
+    node.insert(QStringLiteral("id"), id);
+    node.insert(QStringLiteral("detail"), detail);
+
+    const QStringList words = detail.split(QLatin1Char(' '));
+    const bool scan = words.value(0) == QLatin1String("SCAN");
+    const bool search = words.value(0) == QLatin1String("SEARCH");
+    const bool tempBTree = detail.startsWith(QLatin1String("USE TEMP B-TREE"));
+    node.insert(QStringLiteral("scan"), scan);
+    node.insert(QStringLiteral("search"), search);
+    node.insert(QStringLiteral("tempBTree"), tempBTree);
+    if (tempBTree)
+        node.insert(QStringLiteral("purpose"), detail.mid(detail.indexOf(QLatin1String(" FOR ")) + 5));
+    if ((!scan && !search) || detail == QLatin1String("SCAN CONSTANT ROW"))
+        return node;
+
+    // "SCAN TABLE t" before SQLite 3.36, the alias is named instead of the table if there is one
+    const int tableWord = words.value(1) == QLatin1String("TABLE") ? 2 : 1;
+    node.insert(QStringLiteral("table"), words.value(tableWord));
+    const int usingWord = words.indexOf(QLatin1String("USING"));
+    const int indexWord = words.indexOf(QLatin1String("INDEX"));
+    if (indexWord > 0 && !words.value(indexWord + 1).startsWith(QLatin1Char('(')))
+        node.insert(QStringLiteral("index"), words.value(indexWord + 1));
+    // "SCAN t VIRTUAL TABLE INDEX 0:", the module answers the constraints itself
+    const bool virtualTable = detail.contains(QLatin1String(" VIRTUAL TABLE"));
+    node.insert(QStringLiteral("virtualTable"), virtualTable);
+    node.insert(QStringLiteral("covering"), words.contains(QLatin1String("COVERING")));
+    node.insert(QStringLiteral("automaticIndex"), words.contains(QLatin1String("AUTOMATIC")));
+    node.insert(QStringLiteral("fullScan"), scan && usingWord < 0 && !virtualTable);
+    const int constraint = detail.indexOf(QLatin1String(" ("));
+    if (constraint > 0 && detail.endsWith(QLatin1Char(')')))
+        node.insert(QStringLiteral("constraint"), detail.mid(constraint + 2, detail.size() - constraint - 3));
+    return node;
+}
 
-    const int res = sqlite3_open_v2(db.toUtf8().constData(), &d->access, openMode, NULL);
+static QVariantList qPlanChildren(const QVector<QPair<int, QVariantMap> > &nodes, int parent)
+{
+    QVariantList children;
+    for (int i = 0; i < nodes.count(); ++i) {
+        if (nodes.at(i).first != parent)
+            continue;
+        QVariantMap node = nodes.at(i).second;
+        const QVariantList grandChildren = qPlanChildren(nodes, node.value(QStringLiteral("id")).toInt());
+        if (!grandChildren.isEmpty())
+            node.insert(QStringLiteral("children"), grandChildren);
+        children.append(node);
+    }
+    return children;
+}
 
-    if (res == SQLITE_OK) {
-        if(sqlite3_key(d->access,password.toUtf8(), password.toUtf8().length()) != SQLITE_OK)
-        {
-            if (d->access) {
-                sqlite3_close(d->access);
-                d->access = 0;
+// Collects the columns sql reads per table into reads. Installing an
+// authorizer expires every prepared statement of a connection and replaces
+// the application's authorizer, so sql is prepared on reader, a read-only
+// connection of its own.
+static int qReadColumns(sqlite3 *reader, const QString &sql, QHash<QString, QStringList> *reads)
+{
+    sqlite3_stmt *stmt = 0;
+    sqlite3_set_authorizer(reader, &qReadAuthorizer, reads);
+    const int res = sqlite3_prepare16_v2(reader, sql.constData(), (sql.size() + 1) * sizeof(QChar), &stmt, 0);
+    sqlite3_set_authorizer(reader, 0, 0);
+    sqlite3_finalize(stmt);
+    return res;
+}
+
+// runs EXPLAIN QUERY PLAN on sql with the values bound to query, if given
+static int qExplainQueryPlan(sqlite3 *access, const QString &sql, const QSqlQuery *query, int dateTimeEncoding,
+                             QVariantList *plan)
+{
+    const QString explain = QLatin1String("EXPLAIN QUERY PLAN ") + sql;
+    sqlite3_stmt *stmt = 0;
+    int res = sqlite3_prepare16_v2(access, explain.constData(), (explain.size() + 1) * sizeof(QChar), &stmt, 0);
+    if (res != SQLITE_OK)
+        return res;
+
+    // the plan can depend on the values, e.g. with STAT4 statistics; SQLite has one
+    // parameter per distinct name, so named ones are looked up by name
+    const int paramCount = query ? sqlite3_bind_parameter_count(stmt) : 0;
+    for (int i = 0; i < paramCount; ++i) {
+        const char *name = sqlite3_bind_parameter_name(stmt, i + 1);
+        const QVariant value = name && *name != '?' ? query->boundValue(QString::fromUtf8(name))
+                                                    : query->boundValue(i);
+        qBindValue(stmt, i + 1, value, dateTimeEncoding);
+    }
+
+    QVector<QPair<int, QVariantMap> > nodes;
+    while ((res = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const QString detail = QString(reinterpret_cast<const QChar *>(sqlite3_column_text16(stmt, 3)));
+        nodes.append(qMakePair(sqlite3_column_int(stmt, 1), qPlanNode(sqlite3_column_int(stmt, 0), detail)));
+    }
+    sqlite3_finalize(stmt);
+    if (res != SQLITE_DONE)
+        return res;
+    *plan = qPlanChildren(nodes, 0);
+    return SQLITE_OK;
+}
+
+static bool qIsSqlKeyword(const QString &word)
+{
+    static const char *const keywords[] = {
+        "ALL", "AND", "AS", "ASC", "BETWEEN", "BY", "CASE", "COLLATE", "CROSS", "DELETE", "DESC",
+        "DISTINCT", "ELSE", "END", "EXCEPT", "EXISTS", "FIRST", "FROM", "FULL", "GLOB", "GROUP",
+        "HAVING", "IN", "INDEXED", "INNER", "INSERT", "INTERSECT", "INTO", "IS", "JOIN", "LAST",
+        "LEFT", "LIKE", "LIMIT", "NATURAL", "NOT", "NULL", "NULLS", "OFFSET", "ON", "OR", "ORDER",
+        "OUTER", "RIGHT", "SELECT", "SET", "THEN", "UNION", "UPDATE", "USING", "VALUES", "WHEN",
+        "WHERE", "WINDOW"
+    };
+    const QString upper = word.toUpper();
+    for (const char *keyword : keywords) {
+        if (upper == QLatin1String(keyword))
+            return true;
+    }
+    return false;
+}
+
+// Columns compared for equality or ranges, sort columns and table aliases of
+// a statement, found by scanning its tokens. Columns keep their qualifier
+// (alias.column or table.column). A heuristic for the index advisor, not a
+// parser: subqueries and expressions are not told apart.
+struct QSQLiteExSqlTerms
+{
+    QStringList equal;
+    QStringList range;
+    QStringList order;
+    QHash<QString, QString> aliases;
+};
+
+static QSQLiteExSqlTerms qSqlTerms(const QString &sql)
+{
+    enum Kind { Word, Name, Literal, Operator };
+    QStringList tokens;
+    QVector<int> kinds;
+    const int n = sql.size();
+    for (int i = 0; i < n;) {
+        const QChar c = sql.at(i);
+        const QChar next = i + 1 < n ? sql.at(i + 1) : QChar();
+        if (c.isSpace()) {
+            ++i;
+        } else if (c == QLatin1Char('-') && next == QLatin1Char('-')) {
+            while (i < n && sql.at(i) != QLatin1Char('\n'))
+                ++i;
+        } else if (c == QLatin1Char('/') && next == QLatin1Char('*')) {
+            const int end = sql.indexOf(QLatin1String("*/"), i + 2);
+            i = end < 0 ? n : end + 2;
+        } else if (c == QLatin1Char('\'')) {
+            for (++i; i < n; ++i) {
+                if (sql.at(i) == QLatin1Char('\'')) {
+                    if (i + 1 < n && sql.at(i + 1) == QLatin1Char('\''))
+                        ++i;
+                    else
+                        break;
+                }
             }
-            setLastError(qMakeError(d->access, tr("Error opening database by key"),
-                         QSqlError::ConnectionError, res));
-            setOpenError(true);
-            return false;
+            ++i;
+            tokens.append(QStringLiteral("'"));
+            kinds.append(Literal);
+        } else if (c == QLatin1Char('"') || c == QLatin1Char('`') || c == QLatin1Char('[')) {
+            const QChar close = c == QLatin1Char('[') ? QLatin1Char(']') : c;
+            int end = sql.indexOf(close, i + 1);
+            if (end < 0)
+                end = n;
+            tokens.append(sql.mid(i + 1, end - i - 1));
+            kinds.append(Name);
+            i = end + 1;
+        } else if (c.isLetter() || c == QLatin1Char('_')
+                   || ((c == QLatin1Char(':') || c == QLatin1Char('@') || c == QLatin1Char('$'))
+                       && (next.isLetterOrNumber() || next == QLatin1Char('_')))) {
+            const int start = i++;
+            while (i < n && (sql.at(i).isLetterOrNumber() || sql.at(i) == QLatin1Char('_')
+                             || sql.at(i) == QLatin1Char('$')))
+                ++i;
+            tokens.append(sql.mid(start, i - start));
+            kinds.append(c.isLetter() || c == QLatin1Char('_') ? Word : Literal);
+        } else if (c.isDigit()) {
+            while (i < n && (sql.at(i).isLetterOrNumber() || sql.at(i) == QLatin1Char('.')))
+                ++i;
+            tokens.append(QStringLiteral("0"));
+            kinds.append(Literal);
+        } else {
+            const QString two = sql.mid(i, 2);
+            const bool pair = two == QLatin1String("<=") || two == QLatin1String(">=")
+                    || two == QLatin1String("==") || two == QLatin1String("!=") || two == QLatin1String("<>");
+            tokens.append(pair ? two : QString(c));
+            kinds.append(c == QLatin1Char('?') ? Literal : Operator);
+            i += pair ? 2 : 1;
         }
     }
 
-    if (res == SQLITE_OK) {
-        sqlite3_busy_timeout(d->access, timeOut);
-        setOpen(true);
-        setOpenError(false);
-#if QT_CONFIG(regularexpression)
-        if (defineRegexp) {
-            auto cache = new QCache<QString, QRegularExpression>(regexpCacheSize);
-            sqlite3_create_function_v2(d->access, "regexp", 2, SQLITE_UTF8, cache, &_q_regexp, NULL,
-                                       NULL, &_q_regexp_cleanup);
+    // name.column is one qualified name
+    for (int i = tokens.count() - 3; i >= 0; --i) {
+        if (kinds.at(i) != Operator && kinds.at(i) != Literal && tokens.at(i + 1) == QLatin1String(".")
+                && kinds.at(i + 2) != Operator && kinds.at(i + 2) != Literal) {
+            tokens[i] += QLatin1Char('.') + tokens.at(i + 2);
+            kinds[i] = Name;
+            tokens.removeAt(i + 1);
+            tokens.removeAt(i + 1);
+            kinds.remove(i + 1, 2);
+        }
+    }
+
+    enum Section { Other, From, Where, Order };
+    QSQLiteExSqlTerms terms;
+    Section section = Other;
+    bool expectTable = false;
+    QString lastTable;
+    for (int i = 0; i < tokens.count(); ++i) {
+        const QString &token = tokens.at(i);
+        const bool keyword = kinds.at(i) == Word && qIsSqlKeyword(token);
+        const bool name = (kinds.at(i) == Word && !keyword) || kinds.at(i) == Name;
+        if (keyword) {
+            const QString upper = token.toUpper();
+            if (upper == QLatin1String("FROM") || upper == QLatin1String("JOIN")
+                    || upper == QLatin1String("UPDATE") || upper == QLatin1String("INTO")) {
+                section = From;
+                expectTable = true;
+            } else if (upper == QLatin1String("WHERE") || upper == QLatin1String("ON")
+                       || upper == QLatin1String("HAVING")) {
+                section = Where;
+            } else if (upper == QLatin1String("ORDER")) {
+                section = Order;
+            } else if (upper == QLatin1String("SELECT") || upper == QLatin1String("GROUP")
+                       || upper == QLatin1String("LIMIT") || upper == QLatin1String("UNION")
+                       || upper == QLatin1String("EXCEPT") || upper == QLatin1String("INTERSECT")
+                       || upper == QLatin1String("WINDOW") || upper == QLatin1String("SET")
+                       || upper == QLatin1String("VALUES") || upper == QLatin1String("USING")) {
+                section = Other;
+            }
+            continue;
         }
-#endif
-        return true;
-    } else {
-        setLastError(qMakeError(d->access, tr("Error opening database"),
-                     QSqlError::ConnectionError, res));
-        setOpenError(true);
 
-        if (d->access) {
-            sqlite3_close(d->access);
-            d->access = 0;
+        if (section == From) {
+            if (token == QLatin1String(",")) {
+                expectTable = true;
+            } else if (name && expectTable) {
+                lastTable = token;
+                expectTable = false;
+            } else if (name && !lastTable.isEmpty()) {
+                terms.aliases.insert(token, lastTable);
+                lastTable.clear();
+            }
+        } else if (section == Where && name) {
+            const QString after = tokens.value(i + 1).toUpper();
+            const QString before = i > 0 ? tokens.at(i - 1) : QString();
+            const bool literalBefore = i > 1 && kinds.at(i - 2) == Literal;
+            if (after == QLatin1String("=") || after == QLatin1String("==") || after == QLatin1String("IN")
+                    || after == QLatin1String("IS")
+                    || (literalBefore && (before == QLatin1String("=") || before == QLatin1String("==")))) {
+                if (!terms.equal.contains(token))
+                    terms.equal.append(token);
+            } else if (after == QLatin1String("<") || after == QLatin1String(">") || after == QLatin1String("<=")
+                       || after == QLatin1String(">=") || after == QLatin1String("BETWEEN")
+                       || (literalBefore && (before == QLatin1String("<") || before == QLatin1String(">")
+                                             || before == QLatin1String("<=") || before == QLatin1String(">=")))) {
+                if (!terms.range.contains(token))
+                    terms.range.append(token);
+            }
+        } else if (section == Order && name) {
+            if (!terms.order.contains(token))
+                terms.order.append(token);
         }
+    }
+    return terms;
+}
 
-        return false;
+static void qPlanNodes(const QVariantList &plan, QVariantList *nodes)
+{
+    for (int i = 0; i < plan.count(); ++i) {
+        const QVariantMap node = plan.at(i).toMap();
+        nodes->append(node);
+        qPlanNodes(node.value(QStringLiteral("children")).toList(), nodes);
     }
 }
 
-void QSQLiteExDriver::close()
+// strips the schema of a table name
+static QString qUnqualifiedTable(const QString &table)
 {
-    Q_D(QSQLiteExDriver);
-    if (isOpen()) {
-        for (QSQLiteExResult *result : qAsConst(d->results))
-            result->d_func()->finalize();
+    return table.mid(table.lastIndexOf(QLatin1Char('.')) + 1);
+}
 
-        if (d->access && (d->notificationid.count() > 0)) {
-            d->notificationid.clear();
-            sqlite3_update_hook(d->access, NULL, NULL);
+// the column of a term if it can belong to table: qualified terms only
+// belong to the table their qualifier (table or alias) names, unqualified
+// ones to every table
+static bool qTermColumn(const QSQLiteExSqlTerms &terms, const QString &term, const QString &table,
+                        QString *column)
+{
+    const int dot = term.lastIndexOf(QLatin1Char('.'));
+    *column = term.mid(dot + 1);
+    if (dot < 0)
+        return true;
+    const QString qualifier = term.left(dot);
+    return qUnqualifiedTable(terms.aliases.value(qualifier, qualifier)).compare(table, Qt::CaseInsensitive) == 0;
+}
+
+// appends the column of table named like column, if any and not there yet;
+// returns whether it was appended
+static bool qAppendIndexColumn(QStringList *index, const QStringList &tableColumns, const QString &column)
+{
+    for (int i = 0; i < tableColumns.count(); ++i) {
+        if (tableColumns.at(i).compare(column, Qt::CaseInsensitive) == 0) {
+            if (index->contains(tableColumns.at(i)))
+                return false;
+            index->append(tableColumns.at(i));
+            return true;
         }
+    }
+    return false;
+}
 
-        const int res = sqlite3_close(d->access);
+// Suggests an index for each table the plan scans in full or for which SQLite
+// builds an automatic index: the table's equality columns first, then one
+// range column or, if there is none and a temp B-tree sorts the result, the
+// sort columns, then the other columns read from the table if that keeps
+// the index at most eight columns wide, so it covers the query.
+static QStringList qSuggestIndexes(const QString &sql, const QVariantList &plan,
+                                   const QHash<QString, QStringList> &reads)
+{
+    const QSQLiteExSqlTerms terms = qSqlTerms(sql);
+    QVariantList nodes;
+    qPlanNodes(plan, &nodes);
+    bool sorted = false;
+    for (int i = 0; i < nodes.count(); ++i) {
+        const QVariantMap node = nodes.at(i).toMap();
+        if (node.value(QStringLiteral("tempBTree")).toBool()
+                && node.value(QStringLiteral("purpose")).toString().contains(QLatin1String("ORDER BY")))
+            sorted = true;
+    }
 
-        if (res != SQLITE_OK)
-            setLastError(qMakeError(d->access, tr("Error closing database"), QSqlError::ConnectionError, res));
-        d->access = 0;
-        setOpen(false);
-        setOpenError(false);
+    QStringList suggestions;
+    for (int i = 0; i < nodes.count(); ++i) {
+        const QVariantMap node = nodes.at(i).toMap();
+        // virtual tables such as FTS5 or array tables cannot be indexed
+        if (node.value(QStringLiteral("virtualTable")).toBool()
+                || (!node.value(QStringLiteral("fullScan")).toBool()
+                    && !node.value(QStringLiteral("automaticIndex")).toBool()))
+            continue;
+        const QString nodeTable = node.value(QStringLiteral("table")).toString();
+        const QString table = qUnqualifiedTable(terms.aliases.value(nodeTable, nodeTable));
+        if (!reads.contains(table))
+            continue;
+
+        // the columns after a range column are only of use for covering
+        const QStringList &columns = reads[table];
+        QStringList index;
+        QString column;
+        for (int j = 0; j < terms.equal.count(); ++j) {
+            if (qTermColumn(terms, terms.equal.at(j), table, &column))
+                qAppendIndexColumn(&index, columns, column);
+        }
+        bool range = false;
+        for (int j = 0; j < terms.range.count() && !range; ++j) {
+            if (qTermColumn(terms, terms.range.at(j), table, &column))
+                range = qAppendIndexColumn(&index, columns, column);
+        }
+        if (sorted && !range) {
+            for (int j = 0; j < terms.order.count(); ++j) {
+                if (qTermColumn(terms, terms.order.at(j), table, &column))
+                    qAppendIndexColumn(&index, columns, column);
+            }
+        }
+        if (index.isEmpty())
+            continue;
+        QStringList covering = index;
+        for (int j = 0; j < columns.count(); ++j)
+            qAppendIndexColumn(&covering, columns, columns.at(j));
+        if (covering.count() <= 8)
+            index = covering;
+
+        QString indexName = QLatin1String("idx_") + table + QLatin1Char('_') + index.join(QLatin1Char('_'));
+        indexName.replace(QLatin1Char('.'), QLatin1Char('_'));
+        QStringList escaped;
+        for (int j = 0; j < index.count(); ++j)
+            escaped.append(_q_escapeIdentifier(index.at(j)));
+        const QString statement = QLatin1String("CREATE INDEX ") + _q_escapeIdentifier(indexName)
+                + QLatin1String(" ON ") + _q_escapeIdentifier(table) + QLatin1Char('(')
+                + escaped.join(QLatin1String(", ")) + QLatin1Char(')');
+        if (!suggestions.contains(statement))
+            suggestions.append(statement);
     }
+    return suggestions;
 }
 
-QSqlResult *QSQLiteExDriver::createResult() const
+/*
+   Returns the EXPLAIN QUERY PLAN of the prepared query as a tree: a list
+   of nodes with id, detail and children, flagged scan, search or tempBTree.
+   Scans and searches also name the table (or alias), the index if any, and
+   whether it is covering, automatic or a virtual table; fullScan is set
+   for scans of ordinary tables that use no index. The plan is computed with the values currently bound to query.
+*/
+QVariantList QSQLiteExDriver::explainQueryPlan(const QSqlQuery &query) const
 {
-    return new QSQLiteExResult(this);
+    Q_D(const QSQLiteExDriver);
+    if (!isOpen() || isOpenError() || query.driver() != this)
+        return QVariantList();
+
+    QVariantList plan;
+    const int res = qExplainQueryPlan(d->access, query.lastQuery(), &query, d->dateTimeEncoding, &plan);
+    if (res != SQLITE_OK) {
+        const_cast<QSQLiteExDriver *>(this)->setLastError(qMakeError(d->access, tr("Unable to explain query"),
+                                                                     QSqlError::StatementError, res));
+        return QVariantList();
+    }
+    return plan;
 }
 
-bool QSQLiteExDriver::beginTransaction()
+// explains sql with all parameters NULL
+QVariantList QSQLiteExDriver::explainQueryPlan(const QString &sql) const
 {
+    Q_D(const QSQLiteExDriver);
     if (!isOpen() || isOpenError())
-        return false;
+        return QVariantList();
 
-    QSqlQuery q(createResult());
-    if (!q.exec(QLatin1String("BEGIN"))) {
-        setLastError(QSqlError(tr("Unable to begin transaction"),
-                               q.lastError().databaseText(), QSqlError::TransactionError));
-        return false;
+    QVariantList plan;
+    const int res = qExplainQueryPlan(d->access, sql, 0, d->dateTimeEncoding, &plan);
+    if (res != SQLITE_OK) {
+        const_cast<QSQLiteExDriver *>(this)->setLastError(qMakeError(d->access, tr("Unable to explain query"),
+                                                                     QSqlError::StatementError, res));
+        return QVariantList();
     }
+    return plan;
+}
 
-    return true;
+/*
+   While enabled, every statement of this connection reports its
+   sqlite3_stmt_status counters when it is re-executed or finalized, and
+   those that stepped through at least fullScanThreshold rows of full table
+   scans, sorted with a temp B-tree or built an automatic index are kept
+   for indexAdvice(), at most the 256 with the most full scan steps. Costs
+   three counter reads per execution.
+*/
+void QSQLiteExDriver::setIndexAdvisor(bool enabled, int fullScanThreshold)
+{
+    Q_D(QSQLiteExDriver);
+    d->indexAdvisor = enabled;
+    d->fullScanThreshold = qMax(fullScanThreshold, 1);
 }
 
-bool QSQLiteExDriver::commitTransaction()
+/*
+   Returns the statements flagged by the index advisor, most full scan
+   steps first, each with sql, executions, fullScanSteps, sorts,
+   autoIndexes, its plan and suggested CREATE INDEX statements. The
+   suggestions are derived from the plan and the WHERE and ORDER BY terms
+   of the statement; review them before creating the indexes. The columns
+   a statement reads are collected on a second, read-only connection, so
+   in-memory databases and statements that use temporary tables or
+   functions of this connection get no suggestions.
+*/
+QVariantList QSQLiteExDriver::indexAdvice() const
 {
+    Q_D(const QSQLiteExDriver);
+    QVariantList advice;
     if (!isOpen() || isOpenError())
-        return false;
+        return advice;
+
+    QVector<QPair<qint64, QString> > order;
+    for (auto it = d->statementStats.constBegin(); it != d->statementStats.constEnd(); ++it)
+        order.append(qMakePair(it.value().fullScanSteps, it.key()));
+    std::sort(order.begin(), order.end());
+
+    sqlite3 *reader = 0;
+    if (!order.isEmpty() && !d->databaseName.isEmpty() && d->databaseName != QLatin1String(":memory:")
+            && !d->databaseName.contains(QLatin1String("mode=memory"))) {
+        const int flags = (d->openFlags & ~(SQLITE_OPEN_CREATE | SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX))
+                | SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX;
+        if (sqlite3_open_v2(d->databaseName.toUtf8().constData(), &reader, flags, NULL) != SQLITE_OK
+                || sqlite3_key(reader, d->key.constData(), d->key.size()) != SQLITE_OK) {
+            sqlite3_close(reader);
+            reader = 0;
+        }
+    }
 
-    QSqlQuery q(createResult());
-    if (!q.exec(QLatin1String("COMMIT"))) {
-        setLastError(QSqlError(tr("Unable to commit transaction"),
-                               q.lastError().databaseText(), QSqlError::TransactionError));
-        return false;
+    for (int i = order.count() - 1; i >= 0; --i) {
+        const QString &sql = order.at(i).second;
+        const QSQLiteExStatementStats stats = d->statementStats.value(sql);
+        QVariantMap entry;
+        entry.insert(QStringLiteral("sql"), sql);
+        entry.insert(QStringLiteral("executions"), stats.executions);
+        entry.insert(QStringLiteral("fullScanSteps"), stats.fullScanSteps);
+        entry.insert(QStringLiteral("sorts"), stats.sorts);
+        entry.insert(QStringLiteral("autoIndexes"), stats.autoIndexes);
+
+        QVariantList plan;
+        QHash<QString, QStringList> reads;
+        if (qExplainQueryPlan(d->access, sql, 0, d->dateTimeEncoding, &plan) == SQLITE_OK) {
+            entry.insert(QStringLiteral("plan"), plan);
+            if (reader && qReadColumns(reader, sql, &reads) == SQLITE_OK)
+                entry.insert(QStringLiteral("suggestions"), qSuggestIndexes(sql, plan, reads));
+        }
+        advice.append(entry);
     }
+    sqlite3_close(reader);
+    return advice;
+}
 
-    return true;
+void QSQLiteExDriver::clearIndexAdvice()
+{
+    Q_D(QSQLiteExDriver);
+    d->statementStats.clear();
 }
 
-bool QSQLiteExDriver::rollbackTransaction()
+/////////////////////////////////////////////////////////
+
+class QSQLiteExKeysetPagerPrivate
 {
-    if (!isOpen() || isOpenError())
-        return false;
+public:
+    enum Direction { First, Next, Previous, Last, Seek, DirectionCount };
 
-    QSqlQuery q(createResult());
-    if (!q.exec(QLatin1String("ROLLBACK"))) {
-        setLastError(QSqlError(tr("Unable to rollback transaction"),
-                               q.lastError().databaseText(), QSqlError::TransactionError));
-        return false;
+    QSQLiteExKeysetPagerPrivate() : pageSize(100), descending(false), more(false), fewer(false)
+    {
+        std::fill(queries, queries + DirectionCount, static_cast<QSqlQuery *>(0));
     }
+    ~QSQLiteExKeysetPagerPrivate() { clearQueries(); }
+
+    QString statement(Direction direction) const;
+    bool fetch(Direction direction, const QVariantList &key = QVariantList());
+    void clearQueries();
+
+    QPointer<QSQLiteExDriver> driver;
+    QString table;
+    QStringList columns;
+    QStringList keyColumns;
+    int pageSize;
+    bool descending;
+    QString where;
+    QVariantList whereValues;
+    QSqlQuery *queries[DirectionCount]; // prepared on first use
+
+    QVector<QVariantList> rows;
+    QVariantList firstKey;
+    QVariantList lastKey;
+    bool more; // rows after the current page
+    bool fewer; // rows before the current page
+    QSqlError error;
+};
 
-    return true;
+void QSQLiteExKeysetPagerPrivate::clearQueries()
+{
+    for (int i = 0; i < DirectionCount; ++i) {
+        delete queries[i];
+        queries[i] = 0;
+    }
 }
 
-QStringList QSQLiteExDriver::tables(QSql::TableType type) const
+// SELECT columns, keys FROM table WHERE (filter) AND (keys) > (?, ...) ORDER BY keys LIMIT ?
+// Previous and Last read backwards from the end of the range, fetch() restores the order.
+QString QSQLiteExKeysetPagerPrivate::statement(Direction direction) const
 {
-    QStringList res;
-    if (!isOpen())
-        return res;
+    QStringList selected;
+    for (int i = 0; i < columns.count(); ++i)
+        selected.append(_q_escapeIdentifier(columns.at(i)));
+    QStringList keys;
+    for (int i = 0; i < keyColumns.count(); ++i)
+        keys.append(_q_escapeIdentifier(keyColumns.at(i)));
+
+    const bool backwards = direction == Previous || direction == Last;
+    QStringList conditions;
+    if (!where.isEmpty())
+        conditions.append(QLatin1Char('(') + where + QLatin1Char(')'));
+    if (direction == Next || direction == Previous || direction == Seek) {
+        const bool greater = backwards == descending;
+        QString op = QLatin1String(greater ? ">" : "<");
+        if (direction == Seek)
+            op += QLatin1Char('=');
+        QStringList placeholders;
+        for (int i = 0; i < keys.count(); ++i)
+            placeholders.append(QLatin1String("?"));
+        conditions.append(QLatin1Char('(') + keys.join(QLatin1String(", ")) + QLatin1String(") ") + op
+                          + QLatin1String(" (") + placeholders.join(QLatin1String(", ")) + QLatin1Char(')'));
+    }
 
-    QSqlQuery q(createResult());
-    q.setForwardOnly(true);
+    QStringList order;
+    for (int i = 0; i < keys.count(); ++i)
+        order.append(keys.at(i) + QLatin1String(backwards != descending ? " DESC" : ""));
 
-    QString sql = QLatin1String("SELECT name FROM sqlite_master WHERE %1 "
-                                "UNION ALL SELECT name FROM sqlite_temp_master WHERE %1");
-    if ((type & QSql::Tables) && (type & QSql::Views))
-        sql = sql.arg(QLatin1String("type='table' OR type='view'"));
-    else if (type & QSql::Tables)
-        sql = sql.arg(QLatin1String("type='table'"));
-    else if (type & QSql::Views)
-        sql = sql.arg(QLatin1String("type='view'"));
-    else
-        sql.clear();
+    QString sql = QLatin1String("SELECT ") + (selected + keys).join(QLatin1String(", "))
+            + QLatin1String(" FROM ") + _q_escapeIdentifier(table);
+    if (!conditions.isEmpty())
+        sql += QLatin1String(" WHERE ") + conditions.join(QLatin1String(" AND "));
+    sql += QLatin1String(" ORDER BY ") + order.join(QLatin1String(", ")) + QLatin1String(" LIMIT ?");
+    return sql;
+}
 
-    if (!sql.isEmpty() && q.exec(sql)) {
-        while(q.next())
-            res.append(q.value(0).toString());
-    }
+// reads one row more than a page to know whether there are more
+bool QSQLiteExKeysetPagerPrivate::fetch(Direction direction, const QVariantList &key)
+{
+    if (!driver || !driver->isOpen() || keyColumns.isEmpty() || pageSize <= 0)
+        return false;
 
-    if (type & QSql::SystemTables) {
-        // there are no internal tables beside this one:
-        res.append(QLatin1String("sqlite_master"));
+    QSqlQuery *&query = queries[direction];
+    if (!query) {
+        query = new QSqlQuery(driver->createResult());
+        query->setForwardOnly(true);
+        if (!query->prepare(statement(direction))) {
+            error = query->lastError();
+            delete query;
+            query = 0;
+            return false;
+        }
     }
 
-    return res;
-}
+    int index = 0;
+    for (int i = 0; i < whereValues.count(); ++i)
+        query->bindValue(index++, whereValues.at(i));
+    for (int i = 0; i < key.count(); ++i)
+        query->bindValue(index++, key.at(i));
+    query->bindValue(index, pageSize + 1);
+    if (!query->exec()) {
+        error = query->lastError();
+        return false;
+    }
 
-static QSqlIndex qGetTableInfo(QSqlQuery &q, const QString &tableName, bool onlyPIndex = false)
-{
-    QString schema;
-    QString table(tableName);
-    int indexOfSeparator = tableName.indexOf(QLatin1Char('.'));
-    if (indexOfSeparator > -1) {
-        schema = tableName.left(indexOfSeparator).append(QLatin1Char('.'));
-        table = tableName.mid(indexOfSeparator + 1);
+    const int nCols = columns.count();
+    const int nKeys = keyColumns.count();
+    QVector<QVariantList> page;
+    QVector<QVariantList> pageKeys;
+    page.reserve(pageSize + 1);
+    pageKeys.reserve(pageSize + 1);
+    while (page.count() <= pageSize && query->next()) {
+        QVariantList row;
+        row.reserve(nCols);
+        for (int i = 0; i < nCols; ++i)
+            row.append(query->value(i));
+        QVariantList rowKey;
+        rowKey.reserve(nKeys);
+        for (int i = 0; i < nKeys; ++i)
+            rowKey.append(query->value(nCols + i));
+        page.append(row);
+        pageKeys.append(rowKey);
     }
-    q.exec(QLatin1String("PRAGMA ") + schema + QLatin1String("table_info (") + _q_escapeIdentifier(table) + QLatin1Char(')'));
+    query->finish();
+    if (query->lastError().isValid()) {
+        error = query->lastError();
+        return false;
+    }
+    error = QSqlError();
 
-    QSqlIndex ind;
-    while (q.next()) {
-        bool isPk = q.value(5).toInt();
-        if (onlyPIndex && !isPk)
-            continue;
-        QString typeName = q.value(2).toString().toLower();
-        QString defVal = q.value(4).toString();
-        if (!defVal.isEmpty() && defVal.at(0) == QLatin1Char('\'')) {
-            const int end = defVal.lastIndexOf(QLatin1Char('\''));
-            if (end > 0)
-                defVal = defVal.mid(1, end - 1);
+    const bool beyond = page.count() > pageSize;
+    if (beyond) {
+        page.removeLast();
+        pageKeys.removeLast();
+    }
+    // a short page before the current one is the start, show a full first page instead
+    if (direction == Previous && !beyond)
+        return fetch(First);
+    if (page.isEmpty()) {
+        if (direction == Next) {
+            more = false;
+        } else {
+            rows.clear();
+            firstKey.clear();
+            lastKey.clear();
+            more = fewer = false;
         }
+        return false;
+    }
 
-        QSqlField fld(q.value(1).toString(), qGetColumnType(typeName), tableName);
-        if (isPk && (typeName == QLatin1String("integer")))
-            // INTEGER PRIMARY KEY fields are auto-generated in sqlite
-            // INT PRIMARY KEY is not the same as INTEGER PRIMARY KEY!
-            fld.setAutoValue(true);
-        fld.setRequired(q.value(3).toInt() != 0);
-        fld.setDefaultValue(defVal);
-        ind.append(fld);
+    if (direction == Previous || direction == Last) {
+        std::reverse(page.begin(), page.end());
+        std::reverse(pageKeys.begin(), pageKeys.end());
     }
-    return ind;
+    rows = page;
+    firstKey = pageKeys.first();
+    lastKey = pageKeys.last();
+    switch (direction) {
+    case First:
+        fewer = false;
+        more = beyond;
+        break;
+    case Next:
+        fewer = true;
+        more = beyond;
+        break;
+    case Previous:
+        fewer = beyond;
+        more = true;
+        break;
+    case Last:
+        fewer = beyond;
+        more = false;
+        break;
+    default:
+        // rows before the seek key are not counted, previous() finds out
+        fewer = true;
+        more = beyond;
+        break;
+    }
+    return true;
 }
 
-QSqlIndex QSQLiteExDriver::primaryIndex(const QString &tblname) const
+QSQLiteExKeysetPager::QSQLiteExKeysetPager(const QSQLiteExDriver *driver, const QString &table,
+                                           const QStringList &columns, const QStringList &keyColumns,
+                                           int pageSize, bool descending)
+    : d(new QSQLiteExKeysetPagerPrivate)
 {
-    if (!isOpen())
-        return QSqlIndex();
-
-    QString table = tblname;
-    if (isIdentifierEscaped(table, QSqlDriver::TableName))
-        table = stripDelimiters(table, QSqlDriver::TableName);
-
-    QSqlQuery q(createResult());
-    q.setForwardOnly(true);
-    return qGetTableInfo(q, table, true);
+    d->driver = const_cast<QSQLiteExDriver *>(driver);
+    d->table = table;
+    d->columns = columns;
+    d->keyColumns = keyColumns;
+    d->pageSize = pageSize;
+    d->descending = descending;
 }
 
-QSqlRecord QSQLiteExDriver::record(const QString &tbl) const
+QSQLiteExKeysetPager::~QSQLiteExKeysetPager()
 {
-    if (!isOpen())
-        return QSqlRecord();
-
-    QString table = tbl;
-    if (isIdentifierEscaped(table, QSqlDriver::TableName))
-        table = stripDelimiters(table, QSqlDriver::TableName);
+    delete d;
+}
 
-    QSqlQuery q(createResult());
-    q.setForwardOnly(true);
-    return qGetTableInfo(q, table);
+void QSQLiteExKeysetPager::setFilter(const QString &where, const QVariantList &values)
+{
+    if (where != d->where)
+        d->clearQueries();
+    d->where = where;
+    d->whereValues = values;
 }
 
-QVariant QSQLiteExDriver::handle() const
+/*
+   Each of these loads a page into rows() and returns true, or returns false
+   if there is no such page or on error. next() and previous() then keep the
+   current page, first(), last() and seek() leave rows() empty unless the
+   query failed. previous() returns to a full first page when fewer than
+   pageSize rows are left before the current one.
+*/
+bool QSQLiteExKeysetPager::first()
 {
-    Q_D(const QSQLiteExDriver);
-    return QVariant::fromValue(d->access);
+    return d->fetch(QSQLiteExKeysetPagerPrivate::First);
 }
 
-QString QSQLiteExDriver::escapeIdentifier(const QString &identifier, IdentifierType type) const
+bool QSQLiteExKeysetPager::next()
 {
-    Q_UNUSED(type);
-    return _q_escapeIdentifier(identifier);
+    if (d->rows.isEmpty())
+        return first();
+    return d->more && d->fetch(QSQLiteExKeysetPagerPrivate::Next, d->lastKey);
 }
 
-static void handle_sqlite_callback(void *qobj,int aoperation, char const *adbname, char const *atablename,
-                                   sqlite3_int64 arowid)
+bool QSQLiteExKeysetPager::previous()
 {
-    Q_UNUSED(aoperation);
-    Q_UNUSED(adbname);
-    QSQLiteExDriver *driver = static_cast<QSQLiteExDriver *>(qobj);
-    if (driver) {
-        QMetaObject::invokeMethod(driver, "handleNotification", Qt::QueuedConnection,
-                                  Q_ARG(QString, QString::fromUtf8(atablename)), Q_ARG(qint64, arowid));
-    }
+    if (d->rows.isEmpty())
+        return last();
+    return d->fewer && d->fetch(QSQLiteExKeysetPagerPrivate::Previous, d->firstKey);
 }
 
-bool QSQLiteExDriver::subscribeToNotification(const QString &name)
+bool QSQLiteExKeysetPager::last()
 {
-    Q_D(QSQLiteExDriver);
-    if (!isOpen()) {
-        qWarning("Database not open.");
-        return false;
-    }
+    return d->fetch(QSQLiteExKeysetPagerPrivate::Last);
+}
 
-    if (d->notificationid.contains(name)) {
-        qWarning("Already subscribing to '%s'.", qPrintable(name));
+bool QSQLiteExKeysetPager::seek(const QVariantList &key)
+{
+    if (key.count() != d->keyColumns.count())
         return false;
-    }
-
-    //sqlite supports only one notification callback, so only the first is registered
-    d->notificationid << name;
-    if (d->notificationid.count() == 1)
-        sqlite3_update_hook(d->access, &handle_sqlite_callback, reinterpret_cast<void *> (this));
-
-    return true;
+    return d->fetch(QSQLiteExKeysetPagerPrivate::Seek, key);
 }
 
-bool QSQLiteExDriver::unsubscribeFromNotification(const QString &name)
+const QVector<QVariantList> &QSQLiteExKeysetPager::rows() const
 {
-    Q_D(QSQLiteExDriver);
-    if (!isOpen()) {
-        qWarning("Database not open.");
-        return false;
-    }
+    return d->rows;
+}
 
-    if (!d->notificationid.contains(name)) {
-        qWarning("Not subscribed to '%s'.", qPrintable(name));
-        return false;
-    }
+QVariantList QSQLiteExKeysetPager::firstKey() const
+{
+    return d->firstKey;
+}
 
-    d->notificationid.removeAll(name);
-    if (d->notificationid.isEmpty())
-        sqlite3_update_hook(d->access, NULL, NULL);
+QVariantList QSQLiteExKeysetPager::lastKey() const
+{
+    return d->lastKey;
+}
 
-    return true;
+bool QSQLiteExKeysetPager::hasNext() const
+{
+    return d->more;
 }
 
-QStringList QSQLiteExDriver::subscribedToNotifications() const
+bool QSQLiteExKeysetPager::hasPrevious() const
 {
-    Q_D(const QSQLiteExDriver);
-    return d->notificationid;
+    return d->fewer;
 }
 
-void QSQLiteExDriver::handleNotification(const QString &tableName, qint64 rowid)
+QSqlError QSQLiteExKeysetPager::lastError() const
 {
-    Q_D(const QSQLiteExDriver);
-    if (d->notificationid.contains(tableName)) {
-        emit notification(tableName);
-        emit notification(tableName, QSqlDriver::UnknownSource, QVariant(rowid));
-    }
+    return d->error;
 }
 
 QT_END_NAMESPACE
@@ -13,10 +13,21 @@
 //
 
 #include <QtSql/qsqldriver.h>
+#include <QtCore/qvector.h>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+#include <QtCore/qstringview.h>
+#endif
+
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 struct sqlite3;
+struct sqlite3_context;
+struct sqlite3_value;
 
-#ifdef QT_PLUGIN
+#if defined(QT_PLUGIN) || defined(QSQLITEEX_STATIC)
 #define Q_EXPORT_SQLDRIVER_SQLITE
 #else
 #define Q_EXPORT_SQLDRIVER_SQLITE Q_SQL_EXPORT
@@ -24,9 +35,318 @@ struct sqlite3;
 
 QT_BEGIN_NAMESPACE
 
+class QSqlQuery;
 class QSqlResult;
 class QSQLiteExDriverPrivate;
 
+// Receives the tokens of a tokenizer registered with registerFtsTokenizer().
+// Positions are QChar offsets into the tokenized text.
+class QSQLiteExFtsTokens
+{
+public:
+    // adds the text in [start, end) as token, returns false if tokenizing should stop
+    virtual bool add(int start, int end, bool colocated = false) = 0;
+    // adds token, e.g. a folded form, for the text in [start, end)
+    virtual bool add(const QString &token, int start, int end, bool colocated = false) = 0;
+
+protected:
+    ~QSQLiteExFtsTokens() {}
+};
+
+// flags are the FTS5_TOKENIZE_* flags of the request
+typedef std::function<void(const QString &text, int flags, QSQLiteExFtsTokens &tokens)> QSQLiteExFtsTokenizer;
+// rewrites the token of a parent tokenizer in place, returns false to drop it
+typedef std::function<bool(QString &token)> QSQLiteExFtsTokenFilter;
+
+template <typename T> struct QSQLiteExArrayType;
+
+// A column of a table created with QSQLiteExDriver::createArrayTable(). The
+// values are read in place, row i at data + i * stride, so a plain array or a
+// member of an array of structs can be exposed without copying.
+struct QSQLiteExArrayColumn
+{
+    enum Type {
+        Int32,
+        Int64,
+        Double,
+        Utf8,       // const char *, zero terminated
+        String      // QString
+    };
+
+    QSQLiteExArrayColumn() : type(Int64), data(0), stride(0), sorted(false) {}
+    QSQLiteExArrayColumn(const QString &name, Type type, const void *data, int stride, bool sorted = false)
+        : name(name), type(type), data(data), stride(stride), sorted(sorted) {}
+
+    // column over a plain array, e.g. fromArray("id", ids.constData(), true)
+    template <typename T>
+    static QSQLiteExArrayColumn fromArray(const QString &name, const T *values, bool sorted = false)
+    {
+        return QSQLiteExArrayColumn(name, Type(QSQLiteExArrayType<T>::Value), values, sizeof(T), sorted);
+    }
+
+    // column over a member of an array of structs, e.g. fromMember("price", items.constData(), &Item::price)
+    template <typename T, typename M>
+    static QSQLiteExArrayColumn fromMember(const QString &name, const T *rows, M T::*member, bool sorted = false)
+    {
+        return QSQLiteExArrayColumn(name, Type(QSQLiteExArrayType<M>::Value), &(rows->*member), sizeof(T), sorted);
+    }
+
+    QString name;
+    Type type;
+    const void *data;
+    int stride;
+    // ascending in BINARY collation order, =, <, <=, > and >= then use a binary search
+    bool sorted;
+};
+
+template <> struct QSQLiteExArrayType<int> { enum { Value = QSQLiteExArrayColumn::Int32 }; };
+template <> struct QSQLiteExArrayType<qint64> { enum { Value = QSQLiteExArrayColumn::Int64 }; };
+template <> struct QSQLiteExArrayType<double> { enum { Value = QSQLiteExArrayColumn::Double }; };
+template <> struct QSQLiteExArrayType<const char *> { enum { Value = QSQLiteExArrayColumn::Utf8 }; };
+template <> struct QSQLiteExArrayType<QString> { enum { Value = QSQLiteExArrayColumn::String }; };
+
+// Rows of a query in column buffers, filled by QSQLiteExDriver::fetchColumns().
+// Each column keeps its values of the batch in one contiguous array: integers
+// or reals, or for text (UTF-8) and blobs the bytes of all rows back to back
+// with row i at data[offsets[i], offsets[i + 1]). Bit i of nulls is set if row
+// i is NULL, its value is then 0 or empty. The buffers are reused by the next
+// batch, so they only grow while scanning.
+struct QSQLiteExColumnBatch
+{
+    enum Type { Integer, Real, Text, Blob };
+
+    struct Column
+    {
+        Column() : type(Text) {}
+
+        bool isNull(int row) const { return (nulls[row >> 6] >> (row & 63)) & 1; }
+        const char *bytes(int row) const { return data.data() + offsets[row]; }
+        int size(int row) const { return int(offsets[row + 1] - offsets[row]); }
+        QString text(int row) const { return QString::fromUtf8(bytes(row), size(row)); }
+        // refers to the batch, valid until the next fetchColumns()
+        QByteArray blob(int row) const { return QByteArray::fromRawData(bytes(row), size(row)); }
+
+        QString name;
+        Type type;
+        std::vector<qint64> integers;
+        std::vector<double> reals;
+        std::vector<qint64> offsets;
+        std::vector<char> data;
+        std::vector<quint64> nulls;
+    };
+
+    QSQLiteExColumnBatch() : rowCount(0), overrideTypes(false) {}
+
+    // empty before the first batch, set up again when the batch is used for
+    // another statement; to override the types derived from the declared
+    // column types, set one column per result column and overrideTypes
+    QVector<Column> columns;
+    int rowCount;
+    bool overrideTypes;
+    QByteArray statement; // SQL the columns were set up for
+};
+
+// A value of a QSQLiteExRowBatch. Text (UTF-8) and blob cells point into
+// memory owned by the query, valid until the next fetchRows() on it.
+struct QSQLiteExCell
+{
+    enum Type { Null, Integer, Real, Text, Blob };
+
+    QSQLiteExCell() : type(Null), size(0), integer(0) {}
+
+    QString text() const { return QString::fromUtf8(data, size); }
+    // refers to the cell, does not copy
+    QByteArray blob() const { return QByteArray::fromRawData(data, size); }
+
+    Type type;
+    int size;
+    union {
+        qint64 integer;
+        double real;
+        const char *data;
+    };
+};
+
+// Rows of a query filled by QSQLiteExDriver::fetchRows(), cell (row, column)
+// is cells[row * columnCount + column].
+struct QSQLiteExRowBatch
+{
+    QSQLiteExRowBatch() : columnCount(0), rowCount(0) {}
+
+    const QSQLiteExCell &at(int row, int column) const { return cells[size_t(row) * columnCount + column]; }
+
+    std::vector<QSQLiteExCell> cells;
+    int columnCount;
+    int rowCount;
+};
+
+// Marshalling for functions registered with QSQLiteExDriver::createFunction()
+// and friends, arguments and results are converted without QVariant.
+namespace QSQLiteExFunctionPrivate {
+
+Q_EXPORT_SQLDRIVER_SQLITE qint64 valueInt64(sqlite3_value *value);
+Q_EXPORT_SQLDRIVER_SQLITE double valueDouble(sqlite3_value *value);
+Q_EXPORT_SQLDRIVER_SQLITE const QChar *valueText16(sqlite3_value *value, int *size);
+Q_EXPORT_SQLDRIVER_SQLITE const char *valueBlob(sqlite3_value *value, int *size);
+Q_EXPORT_SQLDRIVER_SQLITE void resultNull(sqlite3_context *context);
+Q_EXPORT_SQLDRIVER_SQLITE void resultInt64(sqlite3_context *context, qint64 value);
+Q_EXPORT_SQLDRIVER_SQLITE void resultDouble(sqlite3_context *context, double value);
+Q_EXPORT_SQLDRIVER_SQLITE void resultText16(sqlite3_context *context, const QChar *text, int size);
+Q_EXPORT_SQLDRIVER_SQLITE void resultBlob(sqlite3_context *context, const char *data, int size);
+Q_EXPORT_SQLDRIVER_SQLITE void resultNoMem(sqlite3_context *context);
+Q_EXPORT_SQLDRIVER_SQLITE void *userData(sqlite3_context *context);
+Q_EXPORT_SQLDRIVER_SQLITE void *aggregateContext(sqlite3_context *context, int size);
+
+template <typename T> struct Arg;
+template <> struct Arg<int> { static int get(sqlite3_value *v) { return int(valueInt64(v)); } };
+template <> struct Arg<uint> { static uint get(sqlite3_value *v) { return uint(valueInt64(v)); } };
+template <> struct Arg<qint64> { static qint64 get(sqlite3_value *v) { return valueInt64(v); } };
+template <> struct Arg<bool> { static bool get(sqlite3_value *v) { return valueInt64(v) != 0; } };
+template <> struct Arg<double> { static double get(sqlite3_value *v) { return valueDouble(v); } };
+template <> struct Arg<float> { static float get(sqlite3_value *v) { return float(valueDouble(v)); } };
+template <> struct Arg<QString> {
+    static QString get(sqlite3_value *v) { int size; const QChar *text = valueText16(v, &size); return QString(text, size); }
+};
+template <> struct Arg<QByteArray> {
+    static QByteArray get(sqlite3_value *v) { int size; const char *data = valueBlob(v, &size); return QByteArray(data, size); }
+};
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+// points into SQLite's buffer, only valid during the call
+template <> struct Arg<QStringView> {
+    static QStringView get(sqlite3_value *v) { int size; const QChar *text = valueText16(v, &size); return QStringView(text, size); }
+};
+#endif
+
+template <typename T> struct Result;
+template <> struct Result<int> { static void set(sqlite3_context *c, int r) { resultInt64(c, r); } };
+template <> struct Result<uint> { static void set(sqlite3_context *c, uint r) { resultInt64(c, r); } };
+template <> struct Result<qint64> { static void set(sqlite3_context *c, qint64 r) { resultInt64(c, r); } };
+template <> struct Result<bool> { static void set(sqlite3_context *c, bool r) { resultInt64(c, r); } };
+template <> struct Result<double> { static void set(sqlite3_context *c, double r) { resultDouble(c, r); } };
+template <> struct Result<float> { static void set(sqlite3_context *c, float r) { resultDouble(c, r); } };
+template <> struct Result<QString> {
+    static void set(sqlite3_context *c, const QString &r) { if (r.isNull()) resultNull(c); else resultText16(c, r.constData(), r.size()); }
+};
+template <> struct Result<QByteArray> {
+    static void set(sqlite3_context *c, const QByteArray &r) { if (r.isNull()) resultNull(c); else resultBlob(c, r.constData(), r.size()); }
+};
+
+template <int...> struct IndexList {};
+template <int N, int... I> struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> {};
+template <int... I> struct MakeIndexList<0, I...> { typedef IndexList<I...> Type; };
+
+template <typename R, typename... A>
+struct Call
+{
+    enum { ArgumentCount = sizeof...(A) };
+    typedef typename MakeIndexList<sizeof...(A)>::Type Indexes;
+
+    template <typename F, int... I>
+    static void invoke(F &&f, sqlite3_context *c, sqlite3_value **argv, IndexList<I...>)
+    {
+        Result<typename std::decay<R>::type>::set(c, f(Arg<typename std::decay<A>::type>::get(argv[I])...));
+    }
+
+    template <typename O, typename M, int... I>
+    static void invokeMember(O *o, M m, sqlite3_context *c, sqlite3_value **argv, IndexList<I...>)
+    {
+        Result<typename std::decay<R>::type>::set(c, (o->*m)(Arg<typename std::decay<A>::type>::get(argv[I])...));
+    }
+};
+
+template <typename... A>
+struct Call<void, A...>
+{
+    enum { ArgumentCount = sizeof...(A) };
+    typedef typename MakeIndexList<sizeof...(A)>::Type Indexes;
+
+    template <typename F, int... I>
+    static void invoke(F &&f, sqlite3_context *, sqlite3_value **argv, IndexList<I...>)
+    {
+        f(Arg<typename std::decay<A>::type>::get(argv[I])...);
+    }
+
+    template <typename O, typename M, int... I>
+    static void invokeMember(O *o, M m, sqlite3_context *, sqlite3_value **argv, IndexList<I...>)
+    {
+        (o->*m)(Arg<typename std::decay<A>::type>::get(argv[I])...);
+    }
+};
+
+// deduces Call<> from a function pointer, member function pointer or lambda
+template <typename F> struct Signature : Signature<decltype(&F::operator())> {};
+template <typename R, typename... A> struct Signature<R (*)(A...)> { typedef Call<R, A...> Type; };
+template <typename C, typename R, typename... A> struct Signature<R (C::*)(A...)> { typedef Call<R, A...> Type; };
+template <typename C, typename R, typename... A> struct Signature<R (C::*)(A...) const> { typedef Call<R, A...> Type; };
+
+template <typename F>
+void scalar(sqlite3_context *c, int, sqlite3_value **argv)
+{
+    typedef typename Signature<F>::Type Sig;
+    Sig::invoke(*static_cast<F *>(userData(c)), c, argv, typename Sig::Indexes());
+}
+
+template <typename F>
+void destroy(void *f)
+{
+    delete static_cast<F *>(f);
+}
+
+// aggregates keep a heap allocated State in the aggregate context
+template <typename State>
+State *state(sqlite3_context *c, bool create)
+{
+    State **slot = static_cast<State **>(aggregateContext(c, create ? int(sizeof(State *)) : 0));
+    if (slot && !*slot && create)
+        *slot = new State;
+    return slot ? *slot : 0;
+}
+
+template <typename State>
+void step(sqlite3_context *c, int, sqlite3_value **argv)
+{
+    typedef typename Signature<decltype(&State::step)>::Type Sig;
+    State *s = state<State>(c, true);
+    if (!s)
+        resultNoMem(c);
+    else
+        Sig::invokeMember(s, &State::step, c, argv, typename Sig::Indexes());
+}
+
+template <typename State>
+void inverse(sqlite3_context *c, int, sqlite3_value **argv)
+{
+    typedef typename Signature<decltype(&State::inverse)>::Type Sig;
+    State *s = state<State>(c, true);
+    if (!s)
+        resultNoMem(c);
+    else
+        Sig::invokeMember(s, &State::inverse, c, argv, typename Sig::Indexes());
+}
+
+template <typename State>
+void value(sqlite3_context *c)
+{
+    typedef typename std::decay<decltype(std::declval<State &>().result())>::type R;
+    State *s = state<State>(c, false);
+    if (s) {
+        Result<R>::set(c, s->result());
+    } else {
+        // no rows were aggregated
+        State empty;
+        Result<R>::set(c, empty.result());
+    }
+}
+
+template <typename State>
+void finalize(sqlite3_context *c)
+{
+    value<State>(c);
+    delete state<State>(c, false);
+}
+
+} // namespace QSQLiteExFunctionPrivate
+
 class Q_EXPORT_SQLDRIVER_SQLITE QSQLiteExDriver : public QSqlDriver
 {
     Q_DECLARE_PRIVATE(QSQLiteExDriver)
@@ -58,8 +378,140 @@ public:
     bool subscribeToNotification(const QString &name) override;
     bool unsubscribeFromNotification(const QString &name) override;
     QStringList subscribedToNotifications() const override;
+
+    Q_INVOKABLE bool backup(const QString &fileName, const QString &password = QString(),
+                            int cipher = -1, int pagesPerStep = 64, int stepDelay = 0);
+    Q_INVOKABLE QByteArray serialize(const QString &schema = QString(), bool allowPlaintext = false);
+    Q_INVOKABLE bool deserialize(const QByteArray &image, bool readOnly = false,
+                                 const QString &schema = QString());
+
+    bool ftsBulkInsert(const QString &table, const QStringList &columns,
+                       const std::function<bool(QVector<QVariant> &row)> &nextRow,
+                       int batchSize = 1000, int automerge = -1, int crisismerge = -1,
+                       bool optimize = true);
+    QSqlQuery ftsSearch(const QString &table, const QString &match, int snippetColumn = -1,
+                        int limit = -1, int snippetTokens = 16) const;
+    bool registerFtsTokenizer(const QString &name, const QSQLiteExFtsTokenizer &tokenizer);
+    bool registerFtsTokenFilter(const QString &name, const QSQLiteExFtsTokenFilter &filter);
+
+    enum FileFormat { Csv, JsonLines };
+
+    Q_INVOKABLE QVariantMap importFile(const QString &fileName, const QString &table,
+                                       const QStringList &columns = QStringList(), int format = Csv,
+                                       bool header = true, int commitInterval = 50000, int parseThreads = 0);
+    Q_INVOKABLE QVariantMap exportQuery(const QString &query, const QString &fileName, int format = Csv,
+                                        bool header = true);
+
+    Q_INVOKABLE bool startMaintenance(const QStringList &createIndexStatements, int analysisLimit = 1000,
+                                      bool fullAnalyze = false, int vacuumPages = 0, int sorterThreads = 0);
+    Q_INVOKABLE void cancelMaintenance();
+    Q_INVOKABLE qint64 incrementalVacuum(int pages = 0);
+    Q_INVOKABLE QVariantMap memoryStatus(bool resetHighwater = false) const;
+
+    int fetchColumns(QSqlQuery &query, QSQLiteExColumnBatch &batch, int maxRows = 1024) const;
+    int fetchRows(QSqlQuery &query, QSQLiteExRowBatch &batch, int maxRows = 1024) const;
+
+    QVariantList explainQueryPlan(const QSqlQuery &query) const;
+    Q_INVOKABLE QVariantList explainQueryPlan(const QString &sql) const;
+    Q_INVOKABLE void setIndexAdvisor(bool enabled, int fullScanThreshold = 1000);
+    Q_INVOKABLE QVariantList indexAdvice() const;
+    Q_INVOKABLE void clearIndexAdvice();
+
+    bool createArrayTable(const QString &name, const QVector<QSQLiteExArrayColumn> &columns, qint64 rowCount);
+    bool dropArrayTable(const QString &name);
+
+    enum FunctionFlag {
+        Deterministic = 0x1,    // same arguments give the same result, allows constant folding
+        Innocuous = 0x2,        // safe to use from views and triggers of untrusted schemas
+        DirectOnly = 0x4        // may only be called from top level SQL
+    };
+
+    // func is a function pointer or lambda, e.g. [](qint64 n, QStringView s) -> double,
+    // argument and result types are deduced and marshalled without QVariant
+    template <typename Func>
+    bool createFunction(const QString &name, Func func, int flags = Deterministic)
+    {
+        typedef typename QSQLiteExFunctionPrivate::Signature<Func>::Type Sig;
+        return createSqlFunction(name, Sig::ArgumentCount, flags, new Func(func),
+                                 &QSQLiteExFunctionPrivate::scalar<Func>, 0, 0, 0, 0,
+                                 &QSQLiteExFunctionPrivate::destroy<Func>);
+    }
+
+    // State is default constructible with step(args...) and result(), one
+    // instance is created per group
+    template <typename State>
+    bool createAggregate(const QString &name, int flags = Deterministic)
+    {
+        typedef typename QSQLiteExFunctionPrivate::Signature<decltype(&State::step)>::Type Sig;
+        return createSqlFunction(name, Sig::ArgumentCount, flags, 0, 0,
+                                 &QSQLiteExFunctionPrivate::step<State>,
+                                 &QSQLiteExFunctionPrivate::finalize<State>, 0, 0, 0);
+    }
+
+    // like createAggregate(), State additionally has inverse(args...) that
+    // removes a row leaving the window frame
+    template <typename State>
+    bool createWindowFunction(const QString &name, int flags = Deterministic)
+    {
+        typedef typename QSQLiteExFunctionPrivate::Signature<decltype(&State::step)>::Type Sig;
+        return createSqlFunction(name, Sig::ArgumentCount, flags, 0, 0,
+                                 &QSQLiteExFunctionPrivate::step<State>,
+                                 &QSQLiteExFunctionPrivate::finalize<State>,
+                                 &QSQLiteExFunctionPrivate::value<State>,
+                                 &QSQLiteExFunctionPrivate::inverse<State>, 0);
+    }
+
+Q_SIGNALS:
+    void backupProgress(int remaining, int pageCount);
+    void maintenanceFinished(bool ok, const QVariantMap &report);
+    void spaceReclaimed(qint64 bytes, qint64 freelistCount);
+
 private Q_SLOTS:
     void handleNotification(const QString &tableName, qint64 rowid);
+
+private:
+    typedef void (*SqlFunction)(sqlite3_context *, int, sqlite3_value **);
+    typedef void (*SqlFinal)(sqlite3_context *);
+    bool createSqlFunction(const QString &name, int argumentCount, int flags, void *userData,
+                           SqlFunction func, SqlFunction step, SqlFinal finalize,
+                           SqlFinal value, SqlFunction inverse, void (*destroy)(void *));
+};
+
+class QSQLiteExKeysetPagerPrivate;
+
+// Pages through a table or view by seeking on a key instead of LIMIT/OFFSET:
+// the next page starts after the key of the last row shown, so it costs the
+// same wherever it is. The key columns have to be NOT NULL and unique together,
+// e.g. a sort column followed by the rowid. The statements for each direction
+// are prepared once and reused.
+class Q_EXPORT_SQLDRIVER_SQLITE QSQLiteExKeysetPager
+{
+public:
+    QSQLiteExKeysetPager(const QSQLiteExDriver *driver, const QString &table, const QStringList &columns,
+                         const QStringList &keyColumns, int pageSize = 100, bool descending = false);
+    ~QSQLiteExKeysetPager();
+
+    // restricts the rows, where may use positional placeholders bound to values
+    void setFilter(const QString &where, const QVariantList &values = QVariantList());
+
+    bool first();
+    bool next();
+    bool previous();
+    bool last();
+    // the page starting at the row with key, or the one after it
+    bool seek(const QVariantList &key);
+
+    // rows of the current page, in the order of columns
+    const QVector<QVariantList> &rows() const;
+    QVariantList firstKey() const;
+    QVariantList lastKey() const;
+    bool hasNext() const;
+    bool hasPrevious() const;
+    QSqlError lastError() const;
+
+private:
+    Q_DISABLE_COPY(QSQLiteExKeysetPager)
+    QSQLiteExKeysetPagerPrivate *d;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,26 @@
+QT -= gui
+QT += sql testlib
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = SqliteCipherBench
+
+SOURCES += \
+        bench_sqliteex.cpp
+
+# the benchmarks call driver methods, so they link the static driver, see SqliteCipher.pro
+DEFINES += QSQLITEEX_STATIC
+INCLUDEPATH += $$PWD/../SqliteCipher
+CONFIG(debug, debug|release){
+    win32: LIBS += -L$$PWD/../output/debug/sqldrivers -lSQLITEEXD
+    else: LIBS += -L$$PWD/../output/debug/sqldrivers -lSQLITEEX
+} else {
+    LIBS += -L$$PWD/../output/release/sqldrivers -lSQLITEEX
+}
+
+CONFIG(debug, debug|release){
+    DESTDIR = $$PWD/../output/debug
+} else {
+    DESTDIR = $$PWD/../output/release
+}
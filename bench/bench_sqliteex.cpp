@@ -0,0 +1,352 @@
+#include <QtTest>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include "mysqlitecipherplugin.h"
+#include "qsql_sqliteex_p.h"
+#include "sqlite3mc_amalgamation.h"
+
+// Benchmarks of the driver's hot paths on an encrypted database. They also
+// serve as the workload for QSQLITEEX_PGO=GENERATE builds.
+class SqliteExBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void fetchValues();
+    void fetchColumns();
+    void fetchRows();
+    void namedPlaceholders();
+    void positionalPlaceholders();
+    void regexp();
+    void like();
+    void glob();
+    void backup_data();
+    void backup();
+    void ftsBulkInsert();
+    void ftsInsert();
+    void secureDelete_data();
+    void secureDelete();
+
+private:
+    enum { Rows = 20000, Columns = 50 };
+
+    bool createWideTable();
+    bool createWordsTable();
+    int countWords(const QString &condition);
+    QStringList documents() const;
+    QSQLiteExDriver *driver() const { return static_cast<QSQLiteExDriver *>(db.driver()); }
+
+    QTemporaryDir dir;
+    QSqlDatabase db;
+    int matchingWords; // words that start with a and contain a z
+};
+
+void SqliteExBench::initTestCase()
+{
+    QVERIFY(dir.isValid());
+    MySqliteCipherPlugin::registerDriver();
+    db = QSqlDatabase::addDatabase(QStringLiteral("QSQLITEEX"), QStringLiteral("bench"));
+    db.setDatabaseName(dir.filePath(QStringLiteral("bench.db")));
+    db.setPassword(QStringLiteral("123456"));
+    db.setConnectOptions(QStringLiteral("QSQLITE_ENABLE_REGEXP"));
+    QVERIFY2(db.open(), qPrintable(db.lastError().text()));
+    QVERIFY(createWideTable());
+    QVERIFY(createWordsTable());
+}
+
+// Rows rows of 50 columns: integers, reals and text in turn
+bool SqliteExBench::createWideTable()
+{
+    QString create = QStringLiteral("CREATE TABLE wide(");
+    QString insert = QStringLiteral("INSERT INTO wide VALUES(");
+    for (int i = 0; i < Columns; ++i) {
+        const char *type = i % 3 == 0 ? "INTEGER" : (i % 3 == 1 ? "REAL" : "TEXT");
+        create += QStringLiteral("%1c%2 %3").arg(i ? QStringLiteral(", ") : QString()).arg(i).arg(QLatin1String(type));
+        insert += i ? QStringLiteral(", ?") : QStringLiteral("?");
+    }
+    QSqlQuery query(db);
+    if (!query.exec(create + QLatin1Char(')')) || !db.transaction() || !query.prepare(insert + QLatin1Char(')')))
+        return false;
+    for (int row = 0; row < Rows; ++row) {
+        for (int i = 0; i < Columns; ++i) {
+            if (i % 3 == 0)
+                query.bindValue(i, row * Columns + i);
+            else if (i % 3 == 1)
+                query.bindValue(i, row / 7.0 + i);
+            else
+                query.bindValue(i, QStringLiteral("row %1 column %2").arg(row).arg(i));
+        }
+        if (!query.exec())
+            return false;
+    }
+    return db.commit();
+}
+
+// Rows pseudo random base 36 words
+bool SqliteExBench::createWordsTable()
+{
+    QSqlQuery query(db);
+    if (!query.exec(QStringLiteral("CREATE TABLE words(id INTEGER PRIMARY KEY, word TEXT)"))
+            || !db.transaction() || !query.prepare(QStringLiteral("INSERT INTO words(word) VALUES(?)")))
+        return false;
+    matchingWords = 0;
+    for (int row = 0; row < Rows; ++row) {
+        const QString word = QString::number(quint64(row) * 2654435761u % 1000003, 36);
+        if (word.startsWith(QLatin1Char('a')) && word.indexOf(QLatin1Char('z'), 1) > 0)
+            ++matchingWords;
+        query.bindValue(0, word);
+        if (!query.exec())
+            return false;
+    }
+    return db.commit();
+}
+
+int SqliteExBench::countWords(const QString &condition)
+{
+    QSqlQuery query(db);
+    if (!query.exec(QStringLiteral("SELECT count(*) FROM words WHERE ") + condition) || !query.next()) {
+        qWarning() << query.lastError().text();
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+
+void SqliteExBench::cleanupTestCase()
+{
+    db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(QStringLiteral("bench"));
+}
+
+// the QVariant per cell path for comparison with fetchColumns() and fetchRows()
+void SqliteExBench::fetchValues()
+{
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    qint64 rows = 0;
+    QBENCHMARK {
+        QVERIFY(query.exec(QStringLiteral("SELECT * FROM wide")));
+        while (query.next()) {
+            for (int i = 0; i < Columns; ++i)
+                query.value(i);
+            ++rows;
+        }
+    }
+    QVERIFY(rows > 0);
+}
+
+void SqliteExBench::fetchColumns()
+{
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    QSQLiteExColumnBatch batch;
+    qint64 rows = 0;
+    QBENCHMARK {
+        QVERIFY(query.exec(QStringLiteral("SELECT * FROM wide")));
+        int count;
+        while ((count = driver()->fetchColumns(query, batch, 4096)) > 0)
+            rows += count;
+        QCOMPARE(count, 0);
+    }
+    QVERIFY(rows > 0);
+}
+
+void SqliteExBench::fetchRows()
+{
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    QSQLiteExRowBatch batch;
+    qint64 rows = 0;
+    QBENCHMARK {
+        QVERIFY(query.exec(QStringLiteral("SELECT * FROM wide")));
+        int count;
+        while ((count = driver()->fetchRows(query, batch, 4096)) > 0)
+            rows += count;
+        QCOMPARE(count, 0);
+    }
+    QVERIFY(rows > 0);
+}
+
+// :low occurs twice, so its value is mapped to two SQLite parameters
+void SqliteExBench::namedPlaceholders()
+{
+    QSqlQuery query(db);
+    QVERIFY(query.prepare(QStringLiteral("SELECT c0 FROM wide WHERE rowid = :low OR c0 BETWEEN :low AND :high")));
+    int id = 0;
+    QBENCHMARK {
+        for (int i = 0; i < 1000; ++i) {
+            id = (id + 7919) % Rows;
+            query.bindValue(QStringLiteral(":low"), id);
+            query.bindValue(QStringLiteral(":high"), id + Columns);
+            QVERIFY(query.exec());
+            query.next();
+        }
+    }
+}
+
+void SqliteExBench::positionalPlaceholders()
+{
+    QSqlQuery query(db);
+    QVERIFY(query.prepare(QStringLiteral("SELECT c0 FROM wide WHERE rowid = ? OR c0 BETWEEN ? AND ?")));
+    int id = 0;
+    QBENCHMARK {
+        for (int i = 0; i < 1000; ++i) {
+            id = (id + 7919) % Rows;
+            query.bindValue(0, id);
+            query.bindValue(1, id);
+            query.bindValue(2, id + Columns);
+            QVERIFY(query.exec());
+            query.next();
+        }
+    }
+}
+
+// REGEXP, LIKE and GLOB select the same words
+void SqliteExBench::regexp()
+{
+    int count = -1;
+    QBENCHMARK {
+        count = countWords(QStringLiteral("word REGEXP '^a.*z'"));
+    }
+    QCOMPARE(count, matchingWords);
+}
+
+void SqliteExBench::like()
+{
+    int count = -1;
+    QBENCHMARK {
+        count = countWords(QStringLiteral("word LIKE 'a%z%'"));
+    }
+    QCOMPARE(count, matchingWords);
+}
+
+void SqliteExBench::glob()
+{
+    int count = -1;
+    QBENCHMARK {
+        count = countWords(QStringLiteral("word GLOB 'a*z*'"));
+    }
+    QCOMPARE(count, matchingWords);
+}
+
+void SqliteExBench::backup_data()
+{
+    QTest::addColumn<int>("cipher");
+    QTest::addColumn<int>("pagesPerStep");
+
+    QTest::newRow("same cipher") << -1 << 64;
+    QTest::newRow("same cipher, 4096 pages per step") << -1 << 4096;
+    QTest::newRow("ChaCha20") << int(CODEC_TYPE_CHACHA20) << 64;
+    QTest::newRow("ChaCha20, 4096 pages per step") << int(CODEC_TYPE_CHACHA20) << 4096;
+}
+
+// copies the whole fixture, re-encrypting it for another cipher
+void SqliteExBench::backup()
+{
+    QFETCH(int, cipher);
+    QFETCH(int, pagesPerStep);
+
+    int copies = 0;
+    QBENCHMARK {
+        const QString fileName = dir.filePath(QStringLiteral("backup%1.db").arg(++copies));
+        QVERIFY2(driver()->backup(fileName, QStringLiteral("654321"), cipher, pagesPerStep),
+                 qPrintable(driver()->lastError().text()));
+        QFile::remove(fileName);
+    }
+}
+
+// Rows documents of eight pseudo random words
+QStringList SqliteExBench::documents() const
+{
+    QStringList documents;
+    quint64 seed = 1;
+    for (int row = 0; row < Rows; ++row) {
+        QString document;
+        for (int i = 0; i < 8; ++i) {
+            seed = seed * 6364136223846793005u + 1442695040888963407u;
+            document += QString::number(seed >> 44, 36) + QLatin1Char(' ');
+        }
+        documents.append(document);
+    }
+    return documents;
+}
+
+// automerge off during the load and one optimize at the end
+void SqliteExBench::ftsBulkInsert()
+{
+    const QStringList texts = documents();
+    QSqlQuery query(db);
+    int tables = 0;
+    QBENCHMARK {
+        const QString table = QStringLiteral("fts_bulk%1").arg(++tables);
+        QVERIFY(query.exec(QStringLiteral("CREATE VIRTUAL TABLE %1 USING fts5(body)").arg(table)));
+        int row = 0;
+        QVERIFY2(driver()->ftsBulkInsert(table, QStringList() << QStringLiteral("body"),
+                                         [&](QVector<QVariant> &values) {
+                                             if (row == texts.count())
+                                                 return false;
+                                             values.append(texts.at(row++));
+                                             return true;
+                                         }),
+                 qPrintable(driver()->lastError().text()));
+    }
+}
+
+// the same documents in one transaction with the default automerge
+void SqliteExBench::ftsInsert()
+{
+    const QStringList texts = documents();
+    QSqlQuery query(db);
+    int tables = 0;
+    QBENCHMARK {
+        const QString table = QStringLiteral("fts_insert%1").arg(++tables);
+        QVERIFY(query.exec(QStringLiteral("CREATE VIRTUAL TABLE %1 USING fts5(body)").arg(table)));
+        QVERIFY(db.transaction());
+        QVERIFY(query.prepare(QStringLiteral("INSERT INTO %1(body) VALUES(?)").arg(table)));
+        for (int row = 0; row < texts.count(); ++row) {
+            query.bindValue(0, texts.at(row));
+            QVERIFY(query.exec());
+        }
+        QVERIFY(db.commit());
+    }
+}
+
+void SqliteExBench::secureDelete_data()
+{
+    QTest::addColumn<QString>("mode");
+
+    QTest::newRow("OFF") << QStringLiteral("OFF");
+    QTest::newRow("ON") << QStringLiteral("ON");
+    QTest::newRow("FAST") << QStringLiteral("FAST");
+}
+
+// deletes a copy of the 50 column table on a connection opened with the mode
+void SqliteExBench::secureDelete()
+{
+    QFETCH(QString, mode);
+
+    const QString connection = QStringLiteral("secure_delete_") + mode;
+    {
+        QSqlDatabase other = QSqlDatabase::cloneDatabase(db, connection);
+        other.setConnectOptions(QStringLiteral("QSQLITE_SECURE_DELETE=") + mode);
+        QVERIFY2(other.open(), qPrintable(other.lastError().text()));
+        QSqlQuery query(other);
+        QVERIFY(query.exec(QStringLiteral("CREATE TABLE doomed AS SELECT * FROM wide")));
+        // every other row, so cells are freed inside pages that stay in use; the
+        // rows are gone afterwards, so the delete cannot be repeated
+        QBENCHMARK_ONCE {
+            QVERIFY(query.exec(QStringLiteral("DELETE FROM doomed WHERE rowid % 2 = 0")));
+        }
+        QVERIFY(query.exec(QStringLiteral("DROP TABLE doomed")));
+    }
+    QSqlDatabase::removeDatabase(connection);
+}
+
+QTEST_GUILESS_MAIN(SqliteExBench)
+
+#include "bench_sqliteex.moc"